@@ -32,43 +32,42 @@ public:
     SPGrid_Allocator_Base(const SPGrid_Allocator_Base&) = delete;
     SPGrid_Allocator_Base& operator=(const SPGrid_Allocator_Base&) = delete;
 
-    SPGrid_Allocator_Base(const ucoord_t xsize_input, const ucoord_t ysize_input, const ucoord_t zsize_input)
+    SPGrid_Allocator_Base(const ucoord_t xsize_input, const ucoord_t ysize_input, const ucoord_t zsize_input, const Page_Policy policy = Page_Policy::Default)
         : SPGrid_Geometry<dim>(xsize_input, ysize_input, zsize_input, block_xbits, block_ybits, T_Mask_Base::block_zbits)
     {
         static_assert(dim == 3, "Dimension mismatch");
-        Check_Compliance();
-        data_ptr = Raw_Allocate(Padded_Volume() << log2_struct);
+        Allocate(policy);
     }
 
-    SPGrid_Allocator_Base(const ucoord_t xsize_input, const ucoord_t ysize_input)
+    SPGrid_Allocator_Base(const ucoord_t xsize_input, const ucoord_t ysize_input, const Page_Policy policy = Page_Policy::Default)
         : SPGrid_Geometry<dim>(xsize_input, ysize_input, block_xbits, block_ybits)
     {
         static_assert(dim == 2, "Dimension mismatch");
-        Check_Compliance();
-        data_ptr = Raw_Allocate(Padded_Volume() << log2_struct);
+        Allocate(policy);
     }
 
-    SPGrid_Allocator_Base(const std::array<ucoord_t, 3> size_in)
+    SPGrid_Allocator_Base(const std::array<ucoord_t, 3> size_in, const Page_Policy policy = Page_Policy::Default)
         : SPGrid_Geometry<dim>(size_in[0], size_in[1], size_in[2], block_xbits, block_ybits, T_Mask_Base::block_zbits)
     {
         static_assert(dim == 3, "Dimension mismatch");
-        Check_Compliance();
-        data_ptr = Raw_Allocate(Padded_Volume() << log2_struct);
+        Allocate(policy);
     }
 
-    SPGrid_Allocator_Base(const std::array<ucoord_t, 2> size_in)
+    SPGrid_Allocator_Base(const std::array<ucoord_t, 2> size_in, const Page_Policy policy = Page_Policy::Default)
         : SPGrid_Geometry<dim>(size_in[0], size_in[1], block_xbits, block_ybits)
     {
         static_assert(dim == 2, "Dimension mismatch");
-        Check_Compliance();
-        data_ptr = Raw_Allocate(Padded_Volume() << log2_struct);
+        Allocate(policy);
     }
 
     ~SPGrid_Allocator_Base()
     {
-        Raw_Deallocate(data_ptr, Padded_Volume() << log2_struct);
+        Raw_Deallocate(data_ptr, Padded_Volume() << log2_struct, page_policy);
     }
 
+    // The policy actually obtained, which may be weaker than the one requested
+    Page_Policy Get_Page_Policy() const { return page_policy; }
+
     void Validate(uint64_t* page_mask_array) const
     {
         Validate_Memory_Use((Padded_Volume() << log2_struct) >> 12, Get_Data_Ptr(), page_mask_array);
@@ -78,7 +77,16 @@ protected:
     inline void* Get_Data_Ptr() const { return data_ptr; }
 
 private:
+    void Allocate(Page_Policy policy)
+    {
+        Check_Compliance();
+        if (policy != Page_Policy::Default) Check_Huge_Page_Compliance(log2_page);
+        data_ptr = Raw_Allocate(Padded_Volume() << log2_struct, policy);
+        page_policy = policy;
+    }
+
     void* data_ptr;
+    Page_Policy page_policy;
 
     //#####################################################################
 };
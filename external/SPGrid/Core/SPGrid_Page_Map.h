@@ -0,0 +1,209 @@
+//#####################################################################
+// Copyright (c) 2012-2016, Eftychios Sifakis, Sean Bauer
+// Distributed under the FreeBSD license (see license.txt)
+//#####################################################################
+#ifndef __SPGrid_Page_Map_h__
+#define __SPGrid_Page_Map_h__
+
+#include <SPGrid/Core/SPGrid_Geometry.h>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+namespace SPGrid {
+//#####################################################################
+// Class SPGrid_Page_Map
+//#####################################################################
+template <int log2_page = 12>
+class SPGrid_Page_Map {
+protected:
+    const uint64_t map_size; // Size of the page map, in uint64_t units. Each entry corresponds to 64 (1<<log2_page) pages.
+    uint64_t* page_map; // The actual page map - a bitmap structured as an array of 64-bit entries.
+    std::vector<uint64_t> summary[2]; // Summary bitmaps: bit i of level 0 is set iff page_map[i] is nonzero, bit i of level 1 iff word i of level 0 is.
+    std::vector<uint64_t> block_offsets; // Alternative representation as a list of kernel_linearized offsets. Created on demand.
+    bool dirty; // Indicates that block offsets are inconsistent with the page map (perhaps for a good reason, if only one of them is used).
+
+public:
+    // Make the pagemap class noncopyable
+    SPGrid_Page_Map(const SPGrid_Page_Map&) = delete;
+    SPGrid_Page_Map& operator=(const SPGrid_Page_Map&) = delete;
+
+    template <int d>
+    SPGrid_Page_Map(const SPGrid_Geometry<d>& geometry)
+        : map_size((geometry.Padded_Volume() / geometry.Elements_Per_Block() + 0x3fUL) >> 6)
+    {
+        page_map = static_cast<uint64_t*>(Raw_Allocate(map_size * sizeof(uint64_t)));
+        summary[0].assign((map_size + 0x3fUL) >> 6, 0);
+        summary[1].assign((summary[0].size() + 0x3fUL) >> 6, 0);
+        dirty = false;
+    }
+
+    ~SPGrid_Page_Map()
+    {
+        Raw_Deallocate(page_map, map_size * sizeof(uint64_t));
+    }
+
+    // Zeroes only the nonzero entries found through the summary bitmaps. The map stays mapped, so activating
+    // pages again takes no page faults.
+    void Clear_Page_Map()
+    {
+        for (uint64_t top = 0; top < summary[1].size(); top++)
+            for (uint64_t upper = summary[1][top]; upper; upper &= upper - 1) {
+                const uint64_t word = (top << 6) | std::countr_zero(upper);
+                for (uint64_t lower = summary[0][word]; lower; lower &= lower - 1)
+                    page_map[(word << 6) | std::countr_zero(lower)] = 0;
+                summary[0][word] = 0;
+            }
+        std::fill(summary[1].begin(), summary[1].end(), 0);
+        dirty = true;
+    }
+
+    void Clear_Blocks()
+    {
+        std::vector<uint64_t>().swap(block_offsets);
+        dirty = true;
+    }
+
+    void Clear()
+    {
+        Clear_Page_Map();
+        Clear_Blocks();
+        dirty = false;
+    }
+
+    // Unset every active page and empty the block list, keeping its capacity. Pages are found through the
+    // summary bitmaps, so blocks of Set_Page_Concurrent() not yet in the list are cleared as well.
+    // Unlike Clear(), the cost is proportional to the number of active blocks rather than to the map size.
+    void Clear_Active_Blocks()
+    {
+        Clear_Page_Map();
+        block_offsets.clear();
+        dirty = false;
+    }
+
+#if 1
+    void Set_Page(const uint64_t offset)
+    {
+        uint64_t mask = 1UL << (offset >> log2_page & 0x3f);
+        uint64_t& entry = page_map[offset >> (log2_page + 6)];
+        if (mask & ~entry) {
+            if (!entry) Set_Summary(offset >> (log2_page + 6));
+            entry |= mask;
+            block_offsets.push_back((offset >> log2_page) << log2_page);
+        }
+        if (!dirty) dirty = true; // Important to avoid unnecessary write sharing
+    }
+#else
+    void Set_Page(const uint64_t offset)
+    {
+        uint64_t mask = 1UL << (offset >> log2_page & 0x3f);
+        uint64_t& entry = page_map[offset >> (log2_page + 6)];
+        if (mask & ~entry) {
+            if (!entry) Set_Summary(offset >> (log2_page + 6));
+            entry |= mask;
+        }
+        if (!dirty) dirty = true; // Important to avoid unnecessary write sharing
+    }
+#endif
+
+    // Thread-safe variant of Set_Page(): any number of threads may activate pages, of the same map entry too.
+    // Only the page map and its summary bitmaps are written, with atomic fetch_or. The new blocks show up in
+    // Get_Blocks() after Update_Block_Offsets(), which must not run concurrently with this.
+    // Set_Page() and Set_Page_Concurrent() must not be mixed within one parallel phase.
+    void Set_Page_Concurrent(const uint64_t offset)
+    {
+        uint64_t mask = 1UL << (offset >> log2_page & 0x3f);
+        std::atomic_ref<uint64_t> entry(page_map[offset >> (log2_page + 6)]);
+        if (entry.load(std::memory_order_relaxed) & mask) return; // Read first, already active pages cause no write sharing
+        const uint64_t previous = entry.fetch_or(mask, std::memory_order_relaxed);
+        if (previous & mask) return;
+        if (!previous) Set_Summary_Concurrent(offset >> (log2_page + 6));
+        std::atomic_ref<bool> dirty_flag(dirty);
+        if (!dirty_flag.load(std::memory_order_relaxed)) dirty_flag.store(true, std::memory_order_relaxed);
+    }
+
+    bool Test_Page(const uint64_t offset) const
+    {
+        uint64_t mask = 1UL << (offset >> log2_page & 0x3f);
+        const uint64_t& entry = page_map[offset >> (log2_page + 6)];
+        return entry & mask;
+    }
+
+    std::pair<const uint64_t*, unsigned> Get_Blocks() const
+    {
+        if (block_offsets.size())
+            return std::pair<const uint64_t*, unsigned>(&block_offsets[0], block_offsets.size());
+        else
+            return std::pair<const uint64_t*, unsigned>((const uint64_t*)0, 0);
+    }
+
+#if 0
+    void Update_Block_Offsets()
+    {
+        dirty = false;
+    }
+#else
+    // Rebuilds the list from the summary bitmaps, in increasing offset order, whenever pages were activated
+    // since the last update. This is how the blocks of Set_Page_Concurrent() are collected.
+    void Update_Block_Offsets()
+    {
+        if (dirty) Generate_Block_Offsets(block_offsets);
+        dirty = false;
+    }
+#endif
+
+    std::vector<uint64_t> Generate_Block_Offsets()
+    {
+        std::vector<uint64_t> block_offsets;
+        Generate_Block_Offsets(block_offsets);
+        return block_offsets;
+    }
+
+    // Descends the summary bitmaps, visiting only nonzero words at every level and only set bits within them.
+    // Apart from the top level, 1/4096 of the page map, the cost is proportional to the number of active blocks.
+    // `block_offsets` is overwritten, its capacity is reused.
+    void Generate_Block_Offsets(std::vector<uint64_t>& block_offsets) const
+    {
+        block_offsets.clear();
+        for (uint64_t top = 0; top < summary[1].size(); top++)
+            for (uint64_t upper = summary[1][top]; upper; upper &= upper - 1) {
+                const uint64_t word = (top << 6) | std::countr_zero(upper);
+                for (uint64_t lower = summary[0][word]; lower; lower &= lower - 1) {
+                    const uint64_t entry = (word << 6) | std::countr_zero(lower);
+                    for (uint64_t bits = page_map[entry]; bits; bits &= bits - 1)
+                        block_offsets.push_back((entry << (log2_page + 6)) | (uint64_t(std::countr_zero(bits)) << log2_page));
+                }
+            }
+    }
+
+private:
+    // Mark page map entry `index` as nonzero, stopping at the first level already marked
+    void Set_Summary(uint64_t index)
+    {
+        for (auto& level : summary) {
+            uint64_t& word = level[index >> 6];
+            const uint64_t mask = 1UL << (index & 0x3f);
+            if (word & mask) return;
+            word |= mask;
+            index >>= 6;
+        }
+    }
+
+    void Set_Summary_Concurrent(uint64_t index)
+    {
+        for (auto& level : summary) {
+            std::atomic_ref<uint64_t> word(level[index >> 6]);
+            const uint64_t mask = 1UL << (index & 0x3f);
+            if (word.load(std::memory_order_relaxed) & mask) return;
+            if (word.fetch_or(mask, std::memory_order_relaxed) & mask) return;
+            index >>= 6;
+        }
+    }
+
+public:
+    //#####################################################################
+};
+} // namespace SPGrid
+#endif
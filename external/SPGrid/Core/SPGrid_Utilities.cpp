@@ -4,10 +4,12 @@
 //#####################################################################
 // Utility classes/functions
 //#####################################################################
+#include <fstream>
 #include <iostream>
 #include <stdexcept>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <unistd.h>
 
 #include <SPGrid/Core/SPGrid_Utilities.h>
@@ -97,6 +99,15 @@ void Check_Compliance()
     if (sizeof(Long_Enum) != 8) FATAL_ERROR("Missing support for 64-bit enums");
 }
 
+//#####################################################################
+// Function Check_Huge_Page_Compliance
+//#####################################################################
+// A huge page must hold a whole number of SPGrid pages, so that no block straddles two huge pages
+void Check_Huge_Page_Compliance(const int log2_page)
+{
+    if (log2_page > log2_huge_page) FATAL_ERROR("SPGrid page of " + Value_To_String(1UL << log2_page) + " bytes is larger than a 2MB huge page");
+}
+
 //#####################################################################
 // Function Raw_Allocate
 //#####################################################################
@@ -108,6 +119,44 @@ void* Raw_Allocate(const size_t size)
     return ptr;
 }
 
+static size_t Huge_Page_Round(const size_t size)
+{
+    return (size + huge_page_size - 1) & ~(huge_page_size - 1);
+}
+
+// madvise(MADV_HUGEPAGE) has no effect when transparent huge pages are disabled system-wide
+static bool Transparent_Huge_Pages_Enabled()
+{
+    std::ifstream input("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string setting;
+    if (!std::getline(input, setting)) return false;
+    return setting.find("[never]") == std::string::npos;
+}
+
+void* Raw_Allocate(const size_t size, Page_Policy& policy)
+{
+    const size_t huge_size = Huge_Page_Round(size);
+    if (policy == Page_Policy::Explicit_Huge) {
+        // No MAP_NORESERVE: the pages are reserved here, so an exhausted pool fails now rather than with SIGBUS at first touch
+        void* ptr = mmap(NULL, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) return ptr;
+        std::cerr << "*** WARNING: hugetlbfs pool cannot reserve " << huge_size / huge_page_size
+                  << " huge pages, falling back to transparent huge pages" << std::endl;
+        policy = Page_Policy::Transparent_Huge;
+    }
+    if (policy == Page_Policy::Transparent_Huge && Transparent_Huge_Pages_Enabled()) {
+        // Over-allocate by one huge page and trim both ends, so that the range starts at a 2MB boundary
+        char* raw = static_cast<char*>(Raw_Allocate(huge_size + huge_page_size));
+        char* ptr = reinterpret_cast<char*>(Huge_Page_Round(reinterpret_cast<uint64_t>(raw)));
+        if (ptr != raw) Raw_Deallocate(raw, ptr - raw);
+        if (ptr != raw + huge_page_size) Raw_Deallocate(ptr + huge_size, raw + huge_page_size - ptr);
+        if (madvise(ptr, huge_size, MADV_HUGEPAGE) == 0) return ptr;
+        Raw_Deallocate(ptr, huge_size);
+    }
+    policy = Page_Policy::Default;
+    return Raw_Allocate(size);
+}
+
 //#####################################################################
 // Function Raw_Deallocate
 //#####################################################################
@@ -115,6 +164,11 @@ void Raw_Deallocate(void* data, const size_t size)
 {
     if (munmap(data, size) != 0) FATAL_ERROR("Failed to deallocate " + Value_To_String(size) + " bytes");
 }
+
+void Raw_Deallocate(void* data, const size_t size, const Page_Policy policy)
+{
+    Raw_Deallocate(data, policy == Page_Policy::Default ? size : Huge_Page_Round(size));
+}
 //#####################################################################
 // Function Deactivate_Page
 //#####################################################################
@@ -129,6 +183,15 @@ void Deactivate_Page(void* data, const size_t size)
     }
 }
 //#####################################################################
+// Function Page_Faults
+//#####################################################################
+uint64_t Page_Faults()
+{
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) FATAL_ERROR("Failed to query resource usage");
+    return usage.ru_minflt + usage.ru_majflt;
+}
+//#####################################################################
 // Function Check_Address_Resident
 //#####################################################################
 void Check_Address_Resident(const void* addr)
@@ -379,12 +379,30 @@ void Fatal_Error(const char* function, const char* file, int line) __attribute__
 void Fatal_Error(const char* function, const char* file, int line, const char* message) __attribute__((noreturn));
 void Fatal_Error(const char* function, const char* file, int line, const std::string& message) __attribute__((noreturn));
 
+//! Physical page backing of an allocation. Transparent_Huge asks the kernel to back every 2MB-aligned range of the allocation with a huge page
+//! (madvise(MADV_HUGEPAGE)), Explicit_Huge maps it from the hugetlbfs pool (MAP_HUGETLB), reserving the whole range up front. Either falls back
+//! to the next policy down when the kernel does not provide it. Huge pages cut TLB misses, but the first touch of a 4KB block makes its whole
+//! 2MB resident.
+//! Limitation: Explicit_Huge reserves huge pages for the entire virtual domain, not for the active blocks, so a sparse grid needs a pool as
+//! large as its dense footprint (a 512^3 grid of 16-byte nodes takes 1024 huge pages). When the pool is too small the allocation falls back
+//! to Transparent_Huge with a warning; sparse domains should ask for Transparent_Huge directly.
+enum class Page_Policy { Default, Transparent_Huge, Explicit_Huge };
+
+constexpr int log2_huge_page = 21;
+constexpr size_t huge_page_size = size_t(1) << log2_huge_page;
+
 // Used during allocation
 void Check_Compliance();
+void Check_Huge_Page_Compliance(const int log2_page);
 void* Raw_Allocate(const size_t size);
+void* Raw_Allocate(const size_t size, Page_Policy& policy); // policy is updated to the one actually obtained
 void Raw_Deallocate(void* data, const size_t size);
+void Raw_Deallocate(void* data, const size_t size, const Page_Policy policy); // policy returned by Raw_Allocate
 void Deactivate_Page(void* data, const size_t size);
 
+// Minor and major page faults of the process so far, differences of it count the faults taken by a piece of code
+uint64_t Page_Faults();
+
 // Used to check address resident
 void Check_Address_Resident(const void* addr);
 
@@ -0,0 +1,320 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace sim::data {
+
+// Per-type operations of a type-erased column. Trivially copyable types are flagged `trivial`
+// and relocated by memcpy, everything else goes through the function table.
+struct TypeOps {
+  size_t size;
+  size_t align;
+  bool trivial;
+
+  void (*construct)(void* dst, size_t n);             // default construct, nullptr if not available
+  void (*move)(void* dst, void* src, size_t n);       // move construct, source stays alive
+  void (*relocate)(void* dst, void* src, size_t n);   // move construct and destroy source
+  void (*destroy)(void* ptr, size_t n);
+
+  template <class Ty>
+  static const TypeOps* of();
+};
+
+namespace detail {
+
+template <class Ty>
+inline constexpr TypeOps type_ops_v = {
+    .size = sizeof(Ty),
+    .align = alignof(Ty),
+    .trivial = std::is_trivially_copyable_v<Ty>,
+    .construct = [] {
+      if constexpr (std::is_default_constructible_v<Ty>) {
+        return +[](void* dst, size_t n) {
+          for (size_t i = 0; i < n; ++i) new (static_cast<Ty*>(dst) + i) Ty();
+        };
+      } else {
+        return static_cast<void (*)(void*, size_t)>(nullptr);
+      }
+    }(),
+    .move =
+        [](void* dst, void* src, size_t n) {
+          if constexpr (std::is_trivially_copyable_v<Ty>) {
+            std::memcpy(dst, src, n * sizeof(Ty));
+          } else {
+            for (size_t i = 0; i < n; ++i) new (static_cast<Ty*>(dst) + i) Ty(std::move(static_cast<Ty*>(src)[i]));
+          }
+        },
+    .relocate =
+        [](void* dst, void* src, size_t n) {
+          if constexpr (std::is_trivially_copyable_v<Ty>) {
+            std::memcpy(dst, src, n * sizeof(Ty));
+          } else {
+            for (size_t i = 0; i < n; ++i) {
+              new (static_cast<Ty*>(dst) + i) Ty(std::move(static_cast<Ty*>(src)[i]));
+              static_cast<Ty*>(src)[i].~Ty();
+            }
+          }
+        },
+    .destroy =
+        [](void* ptr, size_t n) {
+          if constexpr (!std::is_trivially_destructible_v<Ty>) {
+            for (size_t i = 0; i < n; ++i) static_cast<Ty*>(ptr)[i].~Ty();
+          }
+        },
+};
+
+}  // namespace detail
+
+template <class Ty>
+inline const TypeOps* TypeOps::of() {
+  return &detail::type_ops_v<std::remove_cvref_t<Ty>>;
+}
+
+// Type-erased column made of fixed-capacity chunks. Chunks are 64-byte aligned and never move,
+// so growing a column never copies existing elements and element addresses stay stable.
+// Every column of a table shares the same chunk geometry, so chunk `c` of all columns covers the
+// same entity range [c * chunk_size, (c + 1) * chunk_size).
+// Each chunk carries a version stamp: the tick of the last write the owner reported via touch().
+struct Column {
+ public:
+  static constexpr size_t chunk_bits = 12;
+  static constexpr size_t chunk_size = size_t(1) << chunk_bits;
+  static constexpr size_t chunk_mask = chunk_size - 1;
+  static constexpr size_t chunk_align = 64;
+
+  explicit Column(const TypeOps* ops) : ops(ops) {}
+  Column(Column&& other) noexcept;
+  Column(Column const&) = delete;
+  Column& operator=(Column&& other) noexcept;
+  Column& operator=(Column const&) = delete;
+  ~Column();
+
+  template <class Ty>
+  static Column create() {
+    return Column(TypeOps::of<Ty>());
+  }
+
+  // NOTE: use mimic() to create same_type empty instance
+  Column create_mimic() const { return Column(ops); }
+
+  const TypeOps& type() const { return *ops; }
+  size_t size() const { return count; }
+  size_t capacity() const { return chunks.size() << chunk_bits; }
+  size_t chunk_count() const { return (count + chunk_mask) >> chunk_bits; }
+  size_t chunk_rows(size_t chunk) const { return std::min(chunk_size, count - (chunk << chunk_bits)); }
+
+  // bytes held by live elements / by allocated chunks plus the chunk tables
+  size_t used_bytes() const { return count * ops->size; }
+  size_t reserved_bytes() const { return chunks.size() * _chunk_bytes() + chunks.capacity() * sizeof(std::byte*) + versions.capacity() * sizeof(uint64_t); }
+
+  void* operator[](size_t idx) { return chunks[idx >> chunk_bits] + (idx & chunk_mask) * ops->size; }
+  const void* operator[](size_t idx) const { return chunks[idx >> chunk_bits] + (idx & chunk_mask) * ops->size; }
+
+  template <class Ty>
+  Ty& at(size_t idx) {
+    _check_type<Ty>();
+    assert(idx < count);
+    return *static_cast<Ty*>((*this)[idx]);
+  }
+
+  template <class Ty>
+  Ty* chunk(size_t chunk) {
+    _check_type<Ty>();
+    return reinterpret_cast<Ty*>(chunks[chunk]);
+  }
+
+  // change tracking, `tick` is provided by the owner and only ever grows
+  uint64_t version(size_t chunk) const { return versions[chunk]; }
+  void touch(size_t idx, uint64_t tick) { versions[idx >> chunk_bits] = tick; }
+  void touch_chunk(size_t chunk, uint64_t tick) { versions[chunk] = tick; }
+
+  template <class Ty, class... Args>
+  Ty& emplace_back(Args&&... args) {
+    _check_type<Ty>();
+    auto* ptr = new (_grow()) std::remove_cvref_t<Ty>(std::forward<Args>(args)...);
+    ++count;
+    return *ptr;
+  }
+
+  void reserve(size_t n);
+  void extend_one();
+
+  // grow by `n` uninitialized slots and return the index of the first one,
+  // the caller is responsible for constructing every new element in place
+  size_t extend_uninitialized(size_t n);
+  void shrink_one();
+  void clear();
+
+  // release the chunks past the last element
+  void shrink_to_fit();
+
+  // remove element `idx` by moving the last element into its slot
+  void swap_remove(size_t idx);
+
+  // append a moved element from `src`, the source element is left to be removed by the caller
+  void move_back(Column& src, size_t src_idx);
+
+  // relocate element `src_idx` of `src` to the back of this column, the source slot is left
+  // destroyed and has to be filled by src.erase_relocated(src_idx)
+  void relocate_back(Column& src, size_t src_idx);
+
+  // fill the hole left behind by relocate_back() with the last element
+  void erase_relocated(size_t idx);
+
+  // relocate element `order[i]` of `src` into slot `i` for every i in [begin, end). The slots must
+  // come from extend_uninitialized(), disjoint ranges may be filled concurrently.
+  void gather_relocated(Column& src, std::span<const uint32_t> order, size_t begin, size_t end);
+
+  // forget every element without destroying it, once all of them were relocated elsewhere
+  void release_relocated() { count = 0; }
+
+ private:
+  const TypeOps* ops;
+  std::vector<std::byte*> chunks;
+  std::vector<uint64_t> versions;
+  size_t count{0};
+
+  template <class Ty>
+  void _check_type() const {
+    assert(TypeOps::of<Ty>() == ops && "column accessed with mismatched type");
+  }
+
+  size_t _chunk_bytes() const { return ops->size << chunk_bits; }
+  std::align_val_t _chunk_align() const { return std::align_val_t(std::max(chunk_align, ops->align)); }
+
+  void _add_chunk();
+  void* _grow();
+
+  // memcpy fast path for trivially relocatable types, skips the indirect call
+  void _relocate_one(void* dst, void* src) const {
+    if (ops->trivial) {
+      std::memcpy(dst, src, ops->size);
+    } else {
+      ops->relocate(dst, src, 1);
+    }
+  }
+};
+
+inline Column::Column(Column&& other) noexcept : ops(other.ops), chunks(std::move(other.chunks)), versions(std::move(other.versions)), count(other.count) {
+  other.chunks.clear();
+  other.versions.clear();
+  other.count = 0;
+}
+
+inline Column& Column::operator=(Column&& other) noexcept {
+  std::swap(ops, other.ops);
+  std::swap(chunks, other.chunks);
+  std::swap(versions, other.versions);
+  std::swap(count, other.count);
+  return *this;
+}
+
+inline Column::~Column() {
+  clear();
+  for (auto* chunk : chunks) {
+    ::operator delete(chunk, _chunk_align());
+  }
+  chunks.clear();
+  versions.clear();
+}
+
+inline void Column::reserve(size_t n) {
+  if (capacity() >= n) return;
+  chunks.reserve((n + chunk_mask) >> chunk_bits);
+  versions.reserve((n + chunk_mask) >> chunk_bits);
+  while (capacity() < n) _add_chunk();
+}
+
+inline void Column::_add_chunk() {
+  chunks.emplace_back(static_cast<std::byte*>(::operator new(_chunk_bytes(), _chunk_align())));
+  versions.emplace_back(0);
+}
+
+inline void* Column::_grow() {
+  if (count == capacity()) _add_chunk();
+  return (*this)[count];
+}
+
+inline void Column::extend_one() {
+  assert(ops->construct && "value must be set properly for non_default_constructible class");
+  ops->construct(_grow(), 1);
+  ++count;
+}
+
+inline size_t Column::extend_uninitialized(size_t n) {
+  reserve(count + n);
+  auto first = count;
+  count += n;
+  return first;
+}
+
+inline void Column::shrink_one() {
+  assert(count > 0);
+  --count;
+  ops->destroy((*this)[count], 1);
+}
+
+inline void Column::clear() {
+  for (size_t c = 0; c < chunk_count(); ++c) {
+    ops->destroy(chunks[c], chunk_rows(c));
+  }
+  count = 0;
+}
+
+inline void Column::shrink_to_fit() {
+  const auto needed = chunk_count();
+  for (size_t c = needed; c < chunks.size(); ++c) {
+    ::operator delete(chunks[c], _chunk_align());
+  }
+  chunks.resize(needed);
+  versions.resize(needed);
+  chunks.shrink_to_fit();
+  versions.shrink_to_fit();
+}
+
+inline void Column::swap_remove(size_t idx) {
+  assert(idx < count);
+  auto last = count - 1;
+  if (idx != last) {
+    ops->destroy((*this)[idx], 1);
+    _relocate_one((*this)[idx], (*this)[last]);
+    --count;
+  } else {
+    shrink_one();
+  }
+}
+
+inline void Column::move_back(Column& src, size_t src_idx) {
+  assert(ops == src.ops);
+  ops->move(_grow(), src[src_idx], 1);
+  ++count;
+}
+
+inline void Column::relocate_back(Column& src, size_t src_idx) {
+  assert(ops == src.ops);
+  _relocate_one(_grow(), src[src_idx]);
+  ++count;
+}
+
+inline void Column::erase_relocated(size_t idx) {
+  assert(idx < count);
+  auto last = count - 1;
+  if (idx != last) _relocate_one((*this)[idx], (*this)[last]);
+  --count;
+}
+
+inline void Column::gather_relocated(Column& src, std::span<const uint32_t> order, size_t begin, size_t end) {
+  assert(ops == src.ops && end <= count && end <= order.size());
+  for (size_t idx = begin; idx < end; ++idx) _relocate_one((*this)[idx], src[order[idx]]);
+}
+
+}  // namespace sim::data
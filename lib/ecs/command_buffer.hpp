@@ -0,0 +1,303 @@
+#pragma once
+
+#include <tbb/enumerable_thread_specific.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "ecs/neo_ecs.hpp"
+
+namespace sim::ecs {
+
+// Records structural changes (spawn/add/del/destroy) while queries are iterating and applies them later at
+// a sync point. apply() runs one sorted pass: commands are grouped by (source archetype,
+// destination archetype) and every group is migrated with a single Table::move_n.
+struct CommandBuffer {
+ public:
+  CommandBuffer() = default;
+  CommandBuffer(CommandBuffer&& other) noexcept;
+  CommandBuffer(CommandBuffer const&) = delete;
+  CommandBuffer& operator=(CommandBuffer&& other) noexcept;
+  CommandBuffer& operator=(CommandBuffer const&) = delete;
+  ~CommandBuffer();
+
+  // fire-and-forget: the entity is created by apply() and its id is not reported back, store
+  // whatever the caller needs to find it again in one of its components
+  template <class... Ty>
+  void spawn(Ty&&... value);
+
+  template <class... Ty>
+  void add(EntityId eid, Ty&&... value);
+
+  template <class... Ty>
+  void del(EntityId eid);
+
+  void destroy(EntityId eid);
+
+  // take over every command of `other`, they are applied after the ones already recorded
+  void merge(CommandBuffer&& other);
+
+  void apply(World& world);
+
+  void clear();
+
+  size_t size() const { return commands.size(); }
+  bool empty() const { return commands.empty(); }
+
+ private:
+  enum class Kind : uint8_t { spawn, add, del, destroy };
+
+  struct Ops {
+    Kind kind;
+    Archetype& (*target)(World& world, Archetype& src);              // add, del
+    void (*write)(Archetype& dst, EntityId eid, void* payload);      // add
+    void (*spawn_n)(World& world, std::span<void* const> payloads);  // spawn
+    void (*drop)(void* payload);
+  };
+
+  template <class... Ty>
+  struct TypedOps;
+
+  static constexpr Ops destroy_ops{.kind = Kind::destroy, .target = nullptr, .write = nullptr, .spawn_n = nullptr, .drop = nullptr};
+
+  struct Command {
+    EntityId eid;
+    Ops const* ops;
+    void* payload;
+  };
+
+  static constexpr size_t block_bytes = size_t(1) << 16;
+  static constexpr size_t block_align = 64;
+
+  void* _allocate(size_t size, size_t align);
+
+  template <class... Ty>
+  void* _store(Ty&&... value);
+
+  void _apply_structural(World& world);
+
+  void _apply_spawn(World& world);
+
+  std::vector<Command> commands;
+  std::vector<std::byte*> blocks;
+  size_t block_used{block_bytes};
+};
+
+// One CommandBuffer per worker thread for par_for_each systems, merged and applied at the sync point.
+struct ParallelCommandBuffer {
+ public:
+  CommandBuffer& local() { return buffers.local(); }
+
+  void apply(World& world);
+
+ private:
+  tbb::enumerable_thread_specific<CommandBuffer> buffers;
+};
+
+#pragma region Command_Buffer_Impl
+
+template <class... Ty>
+struct CommandBuffer::TypedOps {
+  using payload_t = std::tuple<Ty...>;
+
+  static void drop(void* payload) {
+    if constexpr (sizeof...(Ty) > 0) static_cast<payload_t*>(payload)->~payload_t();
+  }
+
+  static Archetype& add_target(World& world, Archetype& src) { return world.add_to_archetype<Ty...>(src); }
+
+  static Archetype& del_target(World& world, Archetype& src) { return world.del_from_archetype<Ty...>(src); }
+
+  static void write(Archetype& dst, EntityId eid, void* payload) {
+    std::apply([&](auto&... value) { dst.set(eid, std::move(value)...); }, *static_cast<payload_t*>(payload));
+  }
+
+  static void spawn_n(World& world, std::span<void* const> payloads) {
+    world.spawn_n<Ty...>(payloads.size(), [payloads](size_t i) { return std::move(*static_cast<payload_t*>(payloads[i])); });
+  }
+
+  static constexpr Ops spawn_ops{.kind = Kind::spawn, .target = nullptr, .write = nullptr, .spawn_n = &spawn_n, .drop = &drop};
+  static constexpr Ops add_ops{.kind = Kind::add, .target = &add_target, .write = &write, .spawn_n = nullptr, .drop = &drop};
+  static constexpr Ops del_ops{.kind = Kind::del, .target = &del_target, .write = nullptr, .spawn_n = nullptr, .drop = &drop};
+};
+
+inline CommandBuffer::CommandBuffer(CommandBuffer&& other) noexcept
+    : commands(std::move(other.commands)), blocks(std::move(other.blocks)), block_used(other.block_used) {
+  other.commands.clear();
+  other.blocks.clear();
+  other.block_used = block_bytes;
+}
+
+inline CommandBuffer& CommandBuffer::operator=(CommandBuffer&& other) noexcept {
+  std::swap(commands, other.commands);
+  std::swap(blocks, other.blocks);
+  std::swap(block_used, other.block_used);
+  return *this;
+}
+
+inline CommandBuffer::~CommandBuffer() {
+  clear();
+  for (auto* block : blocks) {
+    ::operator delete(block, std::align_val_t(block_align));
+  }
+}
+
+inline void* CommandBuffer::_allocate(size_t size, size_t align) {
+  assert(size <= block_bytes && align <= block_align && "command payload too large");
+  auto offset = (block_used + align - 1) & ~(align - 1);
+  if (blocks.empty() || offset + size > block_bytes) {
+    blocks.emplace_back(static_cast<std::byte*>(::operator new(block_bytes, std::align_val_t(block_align))));
+    offset = 0;
+  }
+  block_used = offset + size;
+  return blocks.back() + offset;
+}
+
+template <class... Ty>
+void* CommandBuffer::_store(Ty&&... value) {
+  using payload_t = std::tuple<std::remove_cvref_t<Ty>...>;
+  if constexpr (sizeof...(Ty) == 0) {
+    return nullptr;
+  } else {
+    return new (_allocate(sizeof(payload_t), alignof(payload_t))) payload_t(std::forward<Ty>(value)...);
+  }
+}
+
+template <class... Ty>
+void CommandBuffer::spawn(Ty&&... value) {
+  static_assert(sizeof...(Ty) > 0, "spawn needs at least one component");
+  commands.push_back({.eid = 0, .ops = &TypedOps<std::remove_cvref_t<Ty>...>::spawn_ops, .payload = _store(std::forward<Ty>(value)...)});
+}
+
+template <class... Ty>
+void CommandBuffer::add(EntityId eid, Ty&&... value) {
+  static_assert(sizeof...(Ty) > 0, "add needs at least one component");
+  commands.push_back({.eid = eid, .ops = &TypedOps<std::remove_cvref_t<Ty>...>::add_ops, .payload = _store(std::forward<Ty>(value)...)});
+}
+
+template <class... Ty>
+void CommandBuffer::del(EntityId eid) {
+  commands.push_back({.eid = eid, .ops = &TypedOps<Ty...>::del_ops, .payload = nullptr});
+}
+
+inline void CommandBuffer::destroy(EntityId eid) { commands.push_back({.eid = eid, .ops = &destroy_ops, .payload = nullptr}); }
+
+inline void CommandBuffer::merge(CommandBuffer&& other) {
+  commands.insert(commands.end(), other.commands.begin(), other.commands.end());
+  // keep our current block as the bump target, payload pointers of `other` stay valid
+  blocks.insert(blocks.begin(), other.blocks.begin(), other.blocks.end());
+  other.commands.clear();
+  other.blocks.clear();
+  other.block_used = block_bytes;
+}
+
+inline void CommandBuffer::clear() {
+  for (auto& command : commands) {
+    if (command.payload) command.ops->drop(command.payload);
+  }
+  commands.clear();
+  while (blocks.size() > 1) {
+    ::operator delete(blocks.back(), std::align_val_t(block_align));
+    blocks.pop_back();
+  }
+  block_used = blocks.empty() ? block_bytes : 0;
+}
+
+inline void CommandBuffer::apply(World& world) {
+  _apply_structural(world);
+  _apply_spawn(world);
+  clear();
+}
+
+inline void CommandBuffer::_apply_structural(World& world) {
+  // Commands touching the same entity must keep their recorded order, so they are split into
+  // waves holding at most one command per entity. Inside a wave the order is free and commands
+  // are sorted by (src, dst) archetype.
+  std::vector<uint32_t> order;
+  for (uint32_t ci = 0; ci < commands.size(); ++ci) {
+    if (commands[ci].ops->kind != Kind::spawn) order.emplace_back(ci);
+  }
+  if (order.empty()) return;
+
+  std::stable_sort(order.begin(), order.end(), [this](uint32_t lhs, uint32_t rhs) { return commands[lhs].eid < commands[rhs].eid; });
+  std::vector<uint32_t> wave(commands.size(), 0);
+  for (size_t i = 1; i < order.size(); ++i) {
+    if (commands[order[i]].eid == commands[order[i - 1]].eid) wave[order[i]] = wave[order[i - 1]] + 1;
+  }
+  std::stable_sort(order.begin(), order.end(), [&wave](uint32_t lhs, uint32_t rhs) { return wave[lhs] < wave[rhs]; });
+
+  struct Step {
+    Archetype* src;
+    Archetype* dst;
+    uint32_t command;
+  };
+  std::vector<Step> steps;
+  std::vector<EntityId> group;
+
+  for (size_t wave_begin = 0, wave_end = 0; wave_begin < order.size(); wave_begin = wave_end) {
+    steps.clear();
+    for (wave_end = wave_begin; wave_end < order.size() && wave[order[wave_end]] == wave[order[wave_begin]]; ++wave_end) {
+      auto& command = commands[order[wave_end]];
+      // the entity was destroyed by an earlier command
+      if (!world.alive(command.eid)) continue;
+      auto& src = *world._record(command.eid).archetype;
+      auto* dst = command.ops->target ? &command.ops->target(world, src) : nullptr;
+      steps.push_back({.src = &src, .dst = dst, .command = order[wave_end]});
+    }
+    std::stable_sort(steps.begin(), steps.end(), [](Step const& lhs, Step const& rhs) { return std::tie(lhs.src, lhs.dst) < std::tie(rhs.src, rhs.dst); });
+
+    for (size_t begin = 0, end = 0; begin < steps.size(); begin = end) {
+      group.clear();
+      for (end = begin; end < steps.size() && steps[end].src == steps[begin].src && steps[end].dst == steps[begin].dst; ++end) {
+        group.emplace_back(commands[steps[end].command].eid);
+      }
+      if (!steps[begin].dst) {
+        world.destroy_n(group);
+        continue;
+      }
+      if (steps[begin].src != steps[begin].dst) {
+        world._move_entities(group, *steps[begin].src, *steps[begin].dst);
+      }
+      // new components are appended in the same order the entities were moved
+      for (size_t i = begin; i < end; ++i) {
+        auto& command = commands[steps[i].command];
+        if (command.ops->write) command.ops->write(*steps[i].dst, command.eid, command.payload);
+      }
+    }
+  }
+}
+
+inline void CommandBuffer::_apply_spawn(World& world) {
+  std::vector<Command*> spawns;
+  for (auto& command : commands) {
+    if (command.ops->kind == Kind::spawn) spawns.emplace_back(&command);
+  }
+  std::stable_sort(spawns.begin(), spawns.end(), [](Command* lhs, Command* rhs) { return std::less<Ops const*>{}(lhs->ops, rhs->ops); });
+
+  std::vector<void*> payloads;
+  for (size_t begin = 0, end = 0; begin < spawns.size(); begin = end) {
+    payloads.clear();
+    for (end = begin; end < spawns.size() && spawns[end]->ops == spawns[begin]->ops; ++end) {
+      payloads.emplace_back(spawns[end]->payload);
+    }
+    spawns[begin]->ops->spawn_n(world, payloads);
+  }
+}
+
+inline void ParallelCommandBuffer::apply(World& world) {
+  CommandBuffer merged;
+  for (auto& buffer : buffers) {
+    merged.merge(std::move(buffer));
+  }
+  merged.apply(world);
+}
+
+#pragma endregion
+
+}  // namespace sim::ecs
@@ -1,15 +1,29 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <exception>
 #include <iterator>
+#include <limits>
+#include <mutex>
+#include <span>
+#include <stdexcept>
 #include <tuple>
 #include <type_traits>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_invoke.h>
+
+#include "ecs/column.hpp"
 #include "forward.hpp"
 
 namespace sim {
@@ -35,6 +49,21 @@ struct vec_equal_t {
   bool operator()(const TVec& lhs, const TVec& rhs) const { return lhs == rhs; }
 };
 
+// approximate heap bytes of a node based hash map: bucket array plus one node per element
+template <class TMap>
+size_t map_bytes(TMap const& map) {
+  return map.bucket_count() * sizeof(void*) + map.size() * (sizeof(typename TMap::value_type) + 2 * sizeof(void*));
+}
+
+template <class THash>
+struct pair_hash_t {
+  template <class TPair>
+  size_t operator()(const TPair& p) const {
+    size_t hash = THash{}(p.first);
+    return hash ^ (THash{}(p.second) + 0x9e3779b9 + (hash << 6) + (hash >> 2));
+  }
+};
+
 template <class Ty>
 constexpr static inline const char* id() {
   return FUNCTION_SIG;
@@ -63,69 +92,89 @@ struct iterator_chain_t {
 
 }  // namespace utils
 
-namespace data {
 
-struct IStorage {
- public:
-  virtual ~IStorage() {}
-  virtual void extend_one(){};
-  virtual void shrink_one(){};
+namespace ecs {
 
- public:
-  // NOTE: use mimic() to create same_type empty instance
-  virtual IStorage* create_mimic() = 0;
-  virtual size_t size() const = 0;
-  virtual void swap(size_t i, size_t j) = 0;
-  virtual void* operator[](size_t offset) = 0;
-  virtual void move(size_t src_idx, IStorage& dst, size_t dst_idx) = 0;
-};
+using Id = uint32_t;
 
-template <typename Ty>
-struct Array : IStorage {
+// Component set of an archetype or a query as a fixed-width bitset indexed by component id.
+// Superset tests and hashing are a few word operations and never allocate.
+struct Signature {
  public:
-  std::vector<Ty> inner_array;
-
-  Array() = default;
-  Array(Array const& array) = delete;
+  static constexpr size_t max_components = 256;
+  static constexpr size_t word_bits = 64;
+  static constexpr size_t word_count = max_components / word_bits;
+
+  Signature& set(Id id) {
+    assert(id < max_components && "too many component types, raise Signature::max_components");
+    words[id / word_bits] |= uint64_t(1) << (id % word_bits);
+    return *this;
+  }
 
-  IStorage* create_mimic() override { return new Array<Ty>(); }
+  Signature& reset(Id id) {
+    assert(id < max_components);
+    words[id / word_bits] &= ~(uint64_t(1) << (id % word_bits));
+    return *this;
+  }
 
-  void swap(size_t i, size_t j) override { std::swap(inner_array[i], inner_array[j]); }
+  bool test(Id id) const { return id < max_components && (words[id / word_bits] >> (id % word_bits)) & 1; }
 
-  void move(size_t src_idx, IStorage& dst_array, size_t dst_idx) override {
-    auto& typed_array = static_cast<Array<Ty>&>(dst_array);
-    typed_array.insert(dst_idx, std::move(inner_array[src_idx]));
+  // every component of `other` is also in this set
+  bool includes(Signature const& other) const {
+    uint64_t missing = 0;
+    for (size_t i = 0; i < word_count; ++i) missing |= other.words[i] & ~words[i];
+    return missing == 0;
   }
 
-  template <class _Ty>
-  auto append(_Ty&& val) {
-    return inner_array.emplace_back(val);
+  bool intersects(Signature const& other) const {
+    uint64_t common = 0;
+    for (size_t i = 0; i < word_count; ++i) common |= other.words[i] & words[i];
+    return common != 0;
   }
 
-  Ty& at(size_t i) { return inner_array.at(i); }
+  bool empty() const { return !intersects(~Signature{}); }
 
-  size_t size() const override { return inner_array.size(); }
+  size_t count() const {
+    size_t n = 0;
+    for (auto word : words) n += std::popcount(word);
+    return n;
+  }
 
-  void* operator[](size_t idx) override { return &inner_array[idx]; }
+  Signature operator~() const {
+    Signature result;
+    for (size_t i = 0; i < word_count; ++i) result.words[i] = ~words[i];
+    return result;
+  }
 
-  void extend_one() override {
-    if constexpr (std::is_default_constructible_v<Ty>) {
-      append(std::move(Ty()));
-    } else {
-      assert(false && "value must be set properly for non_default_constructible class");
-    }
+  Signature operator|(Signature const& other) const {
+    Signature result;
+    for (size_t i = 0; i < word_count; ++i) result.words[i] = words[i] | other.words[i];
+    return result;
   }
 
-  void shrink_one() override { inner_array.pop_back(); }
+  bool operator==(Signature const& other) const = default;
+
+  struct hash_t {
+    size_t operator()(Signature const& sig) const {
+      uint64_t hash = 0;
+      for (auto word : sig.words) {
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+        hash ^= hash >> 32;
+      }
+      return size_t(hash);
+    }
+  };
 
-  void insert(size_t pos, Ty&& val) { inner_array.insert(inner_array.begin() + pos, val); }
+  std::array<uint64_t, word_count> words{};
 };
-}  // namespace data
 
-namespace ecs {
+// Entity handle: the low 32 bits index the world's entity records, the high 32 bits hold the
+// generation of that slot. Destroying an entity bumps the generation, so stale handles are rejected.
+using EntityId = uint64_t;
 
-using Id = uint32_t;
-using Tag = std::vector<Id>;
+inline constexpr uint32_t entity_index(EntityId eid) { return uint32_t(eid); }
+inline constexpr uint32_t entity_generation(EntityId eid) { return uint32_t(eid >> 32); }
+inline constexpr EntityId make_entity_id(uint32_t index, uint32_t generation) { return (EntityId(generation) << 32) | index; }
 
 struct Entity {
  public:
@@ -144,10 +193,14 @@ struct Entity {
   template <typename... Tys>
   Entity& del();
 
-  Entity(Id eid, struct World* world);
+  bool alive() const;
+
+  void destroy();
+
+  Entity(EntityId eid, struct World* world);
 
  public:
-  Id eid;
+  EntityId eid;
   World* world;
 };
 
@@ -157,11 +210,15 @@ struct Table {
   struct World* world;
 
  private:
-  std::vector<Id> col2id;
+  // dense half of the entity sparse set, the sparse half is World::entity_records
+  std::vector<EntityId> col2id;
   std::vector<Id> row2id;
-  std::unordered_map<Id, size_t> id2col;
   std::unordered_map<Id, size_t> id2row;
-  std::vector<data::IStorage*> data;
+  Signature components;
+  std::vector<data::Column> data;
+
+  // dst_table_id -> row mapping, rows never change once a table is created
+  std::unordered_map<Id, std::vector<size_t>> move_mappings;
 
  public:
   Table(Id tid, World* world);
@@ -173,7 +230,7 @@ struct Table {
   template <bool is_add_or_del, class... Ty>
   static Table creator(Id tid, Table const& src_table);
 
-  ~Table();
+  ~Table() = default;
   Table() = default;
   Table(Table&& table) = default;
   Table(Table const&) = delete;
@@ -194,50 +251,83 @@ struct Table {
 
   size_t rows() const { return row2id.size(); }
   size_t cols() const { return col2id.size(); }
+
+  // entity id stored in each column, same order as the component columns
+  std::vector<EntityId> const& entities() const { return col2id; }
   bool ready() const;
 
-  data::IStorage& row(size_t idx) const;
+  data::Column& row(size_t idx);
+  data::Column const& row(size_t idx) const;
 
   // Helper: get row by type
   template <class Ty>
-  data::Array<Ty>& row() const;
+  data::Column& row();
 
-  Tag unsort_tag() const { return row2id; };
+  Signature const& signature() const { return components; }
 
   template <class... Ty>
-  std::tuple<Ty&...> at(Id id);
+  std::tuple<Ty&...> at(EntityId eid);
 
   template <class... Ty>
-  void set(Id id, Ty&&... val);
+  void set(EntityId eid, Ty&&... val);
 
-  bool has(Id id) const;
+  bool has(EntityId eid) const;
 
   template <class... Ty>
   bool has() const;
 
   template <class... Ty>
-  void add(Id id, Ty&&... val);
+  void add(EntityId eid, Ty&&... val);
+
+  // append the entities `eids`, components are produced by `generator(i) -> std::tuple<Ty...>`
+  // and constructed in parallel directly inside the columns. If any of them throws, the elements
+  // already built are destroyed, the table is left unchanged and the first exception is rethrown.
+  template <class... Ty, class TFn>
+  void add_n(std::span<const EntityId> eids, TFn&& generator);
+
+  // remove the entity and its components, the caller releases its record
+  void del(EntityId eid);
+
+  void del_n(std::span<const EntityId> eids);
+
+  void move(EntityId eid, Table& dst_table);
 
-  void del(Id id);
+  // batch migration: every entity of `eids` is relocated to the back of `dst_table` and its hole is
+  // filled from the back of this table, one column at a time.
+  void move_n(std::span<const EntityId> eids, Table& dst_table);
 
-  void move(Id id, Table& dst_table);
+  // reorder the entities so that column `i` holds the entity previously at column `order[i]`,
+  // e.g. to sort them by a spatial key. Every component column follows, records are updated in place.
+  void permute(std::span<const uint32_t> order);
 
   template <class... Ty, class TFn>
   void for_each_col(TFn&& func);
 
   template <class Ty>
-  std::vector<Ty>& get_row();
+  data::Column& typed_row();
 
-  template <class Ty>
-  data::Array<Ty>& typed_row() const;
+  struct ArchetypeStats stats() const;
+
+  // release column chunks and index slack past the last entity
+  void shrink_to_fit();
 
  private:
   void _append_empty_if_needed();
 
   static void _move_elemt(Table& src_table, size_t src_row, size_t src_col, Table& dst_table, size_t dst_row, size_t dst_col);
 
-  template <class Ty>
-  data::Array<Ty>& _typed_row(size_t row) const;
+  // row of `dst_table` receiving each of our rows, npos when the component is dropped
+  std::vector<size_t> const& _row_mapping(Table const& dst_table);
+
+  // remove `eid` from the column index with swap_end semantic and return its former column,
+  // the record of the entity filling the hole is updated
+  size_t _detach(EntityId eid);
+
+  // append `eid` to the column index and point its record to this table
+  void _attach(EntityId eid);
+
+  // stamp the chunk holding `col` in every column that currently covers it
+  void _touch(size_t col, uint64_t tick);
 
   template <class Ty>
   void _del_row();
@@ -251,60 +341,139 @@ struct Table {
 };
 using Archetype = Table;
 
+// Change filter of one iteration pass: chunks not written after `since` are skipped (0 visits
+// every chunk) and visited chunks of non-const columns are stamped with `tick` (0 stamps nothing).
+struct ChunkFilter {
+  uint64_t since{0};
+  uint64_t tick{0};
+};
+
 template <class... Ty>
 struct TableView {
   using val_t = std::tuple<Ty...>;
   using ref_t = std::tuple<Ty&...>;
   using cref_t = std::tuple<Ty const&...>;
 
+  template <class>
+  using column_ptr_t = data::Column*;
+  using col_pack_t = std::tuple<column_ptr_t<Ty>...>;
+  using ptr_pack_t = std::tuple<Ty*...>;
+
   struct view_iterator {
     using value_type = val_t;
     using reference_type = ref_t;
     using difference_type = ptrdiff_t;
-    using vec_iters_t = std::tuple<typename std::vector<Ty>::iterator...>;
 
-    vec_iters_t vec_iters;
+    col_pack_t col_pack;
     difference_type offset;
 
     view_iterator& advance(difference_type step) {
       offset += step;
-      std::apply([step](auto&&... vec_iter) { ((vec_iter += step), ...); }, vec_iters);
       return *this;
     }
 
     reference_type operator*() {
-      return std::apply([](auto&&... vec_iter) { return std::forward_as_tuple(*vec_iter...); }, vec_iters);
+      return std::apply([this](auto*... col) { return std::forward_as_tuple(col->template at<Ty>(offset)...); }, col_pack);
     }
 
     view_iterator& operator++() { return advance(1); }
 
     bool operator<(view_iterator const& rhs) const { return offset < rhs.offset; }
 
-    bool operator!=(view_iterator const& rhs) const { return (*this < rhs) || !(rhs < *this); }
+    bool operator!=(view_iterator const& rhs) const { return offset != rhs.offset; }
   };
 
-  using vec_pack_t = std::tuple<std::vector<Ty>&...>;
-  using cvec_pack_t = std::tuple<std::vector<Ty> const&...>;
+  Table* table;
+  col_pack_t col_pack;
+
+  TableView(Table& table) : table(&table), col_pack(&table.typed_row<Ty>()...) {}
 
-  size_t vec_size;
-  vec_pack_t vec_pack;
+  size_t size() const { return table->cols(); }
 
-  TableView(Table& table) : vec_size(table.cols()), vec_pack(table.get_row<Ty>()...) {}
+  size_t chunk_count() const { return (size() + data::Column::chunk_mask) >> data::Column::chunk_bits; }
 
+  size_t chunk_rows(size_t chunk) const { return std::min(data::Column::chunk_size, size() - (chunk << data::Column::chunk_bits)); }
+
+  ptr_pack_t chunk(size_t chunk) {
+    return std::apply([chunk](auto*... col) { return ptr_pack_t(col->template chunk<Ty>(chunk)...); }, col_pack);
+  }
+
+  // newest version stamp of `chunk` over the viewed columns
+  uint64_t chunk_version(size_t chunk) const {
+    uint64_t version = 0;
+    std::apply([&](auto*... col) { ((version = std::max(version, col->version(chunk))), ...); }, col_pack);
+    return version;
+  }
+
+  // stamp `chunk` of every column viewed as non-const
+  void touch_chunk(size_t chunk, uint64_t tick) {
+    [&]<size_t... I>(std::index_sequence<I...>) {
+      ((std::is_const_v<Ty> || (std::get<I>(col_pack)->touch_chunk(chunk, tick), true)), ...);
+    }(std::index_sequence_for<Ty...>{});
+  }
+
+  // whether `chunk` passes `filter`, stamping it when it does
+  bool visit(size_t chunk, ChunkFilter const& filter) {
+    if (filter.since && chunk_version(chunk) <= filter.since) return false;
+    if (filter.tick) touch_chunk(chunk, filter.tick);
+    return true;
+  }
+
+  // iterate chunk by chunk, inside one chunk every component is a plain contiguous array
   template <class TFunc>
-  void for_each(TFunc&& func) {
-    for (decltype(vec_size) idx = 0; idx < vec_size; ++idx) {
-      std::apply([idx, &func](auto&&... data_row) { func(data_row[idx]...); }, vec_pack);
+  void for_each(TFunc&& func, ChunkFilter const& filter = {}) {
+    for (size_t c = 0; c < chunk_count(); ++c) {
+      if (!visit(c, filter)) continue;
+      const auto rows = chunk_rows(c);
+      std::apply(
+          [rows, &func](auto*... data_row) {
+            for (size_t idx = 0; idx < rows; ++idx) func(data_row[idx]...);
+          },
+          chunk(c));
+    }
+  }
+
+  // `func(std::span<Ty>...)` once per chunk, every span covers the same entities
+  template <class TFunc>
+  void for_each_batch(TFunc&& func, ChunkFilter const& filter = {}) {
+    for (size_t c = 0; c < chunk_count(); ++c) {
+      if (!visit(c, filter)) continue;
+      const auto rows = chunk_rows(c);
+      std::apply([rows, &func](auto*... data_row) { func(std::span<Ty>(data_row, rows)...); }, chunk(c));
+    }
+  }
+
+  // same as for_each, `func(EntityId eid, Ty&...)` additionally receives the entity id
+  template <class TFunc>
+  void for_each_entity(TFunc&& func, ChunkFilter const& filter = {}) {
+    auto const& eids = table->entities();
+    for (size_t c = 0; c < chunk_count(); ++c) {
+      if (!visit(c, filter)) continue;
+      const auto rows = chunk_rows(c);
+      const auto* chunk_eids = eids.data() + (c << data::Column::chunk_bits);
+      std::apply(
+          [rows, chunk_eids, &func](auto*... data_row) {
+            for (size_t idx = 0; idx < rows; ++idx) func(chunk_eids[idx], data_row[idx]...);
+          },
+          chunk(c));
     }
   }
 
   view_iterator begin() { return iter(0); }
 
-  view_iterator end() { return iter(vec_size); }
+  view_iterator end() { return iter(size()); }
 
-  view_iterator iter(ptrdiff_t offset) {
-    return view_iterator{.vec_iters = std::apply([offset](auto&&... vec) { return std::forward_as_tuple((std::begin(vec) + offset)...); }, vec_pack), .offset = offset};
-  }
+  view_iterator iter(ptrdiff_t offset) { return view_iterator{.col_pack = col_pack, .offset = offset}; }
+};
+
+// World-owned match list of one query signature. Archetypes are matched once when the cache is
+// created and every archetype created afterwards is appended by World::deduce_archetype.
+struct QueryCache {
+  Signature with;
+  Signature without;
+  std::vector<Table*> tables;
+
+  bool match(Signature const& arch_sig) const { return arch_sig.includes(with) && !arch_sig.intersects(without); }
 };
 
 template <class... Ty>
@@ -317,42 +486,193 @@ struct Query {
   Query(struct World*);
 
   void initialize();
+
+  // only match archetypes that also own every component of `Tys...`, e.g. a tag component
+  template <class... Tys>
+  Query& with();
+
+  // skip archetypes owning any component of `Tys...`
+  template <class... Tys>
+  Query& without();
+
+  // only visit chunks written after `tick` (a value of World::change_tick()), 0 disables the filter.
+  // Iterating with non-const components stamps the visited chunks as written.
+  Query& changed_since(uint64_t tick);
+
   template <class TFn>
   void for_each(TFn&& func);
 
+  // block iteration, `func(std::span<Ty>...)` receives each contiguous run of the matched
+  // archetypes, so the body can be written as a vectorized kernel over whole arrays
+  template <class TFn>
+  void for_each_batch(TFn&& func);
+
+  // `func(EntityId eid, Ty&...)`, e.g. to record structural changes of the visited entity
+  template <class TFn>
+  void for_each_entity(TFn&& func);
+
+  // rows per parallel task, ranges never cross a column chunk so it is capped by Column::chunk_size
+  Query& grain(size_t rows);
+
+  // per-element parallel iteration, `func` is called concurrently from the worker threads
+  template <class TFn>
+  void par_for_each(TFn&& func);
+
+  // ranged parallel iteration, `func(std::span<Ty>...)` receives one contiguous range per call
+  template <class TFn>
+  void par_for_each_chunk(TFn&& func);
+
+  // parallel `func(EntityId eid, Ty&...)`
+  template <class TFn>
+  void par_for_each_entity(TFn&& func);
+
  private:
+  struct Range {
+    size_t view;
+    size_t begin;
+    size_t end;
+  };
+
+  std::vector<Range> _split_ranges(ChunkFilter const& filter);
+
+  ChunkFilter _filter();
+
+  // run `func(view, begin, end)` over every range on the worker threads
+  template <class TFn>
+  void _par_for_each_range(TFn&& func);
+
+  // pick up archetypes appended to the cache since the last iteration
+  void _sync_views();
+
   struct World* world;
+  QueryCache* cache{nullptr};
   std::vector<TableView<Ty...>> views;
+  size_t grain_size{data::Column::chunk_size};
+  uint64_t since{0};
+};
+
+// Location of one entity slot, indexed by entity_index(eid). A slot without archetype is free.
+struct EntityRecord {
+  Archetype* archetype{nullptr};
+  uint32_t col{0};
+  uint32_t generation{0};
+};
+
+struct ColumnStats {
+  Id component;
+  size_t element_bytes;
+  size_t size;
+  size_t capacity;
+  size_t used_bytes;
+  size_t reserved_bytes;
+};
+
+struct ArchetypeStats {
+  Id tid;
+  Signature signature;
+  size_t entities;
+  std::vector<ColumnStats> columns;
+  size_t used_bytes;
+  size_t reserved_bytes;
+  // col2id, row index and cached move mappings
+  size_t index_bytes;
+};
+
+// Memory breakdown of a World. `reserved` counts allocated bytes, `used` the part holding live
+// data; the difference is chunk and vector slack.
+struct WorldStats {
+  std::vector<ArchetypeStats> archetypes;
+  size_t entities;
+  size_t entity_slots;
+  size_t free_slots;
+  size_t column_used_bytes;
+  size_t column_reserved_bytes;
+  // entity records, free list, archetype tables, graph edges and query caches
+  size_t index_bytes;
+
+  size_t total_bytes() const { return column_reserved_bytes + index_bytes; }
+  double fragmentation() const { return column_reserved_bytes ? 1.0 - double(column_used_bytes) / double(column_reserved_bytes) : 0.0; }
 };
 
 struct World {
+  friend struct Table;
+  friend struct CommandBuffer;
+  template <class...>
+  friend struct Query;
+
  public:
   template <class... Ty>
   using Map = std::unordered_map<Ty...>;
 
   template <class... Ty>
-  Entity& entity();
+  Entity entity();
 
   template <class... Ty>
-  Entity& entity(Ty&&... args);
+  Entity entity(Ty&&... args);
+
+  // bulk creation: resolve the archetype once, reserve every column once and fill them in parallel.
+  // `generator(i) -> std::tuple<Ty...>` is called concurrently for i in [0, count).
+  // Returns the ids of the new entities, they are the tail of the archetype's entity list and the
+  // span stays valid until the next structural change of that archetype. Slots released by
+  // destroy() are reused first, the remaining ids are contiguous. If the generator or a component
+  // constructor throws, no entity is spawned and the exception is propagated.
+  template <class... Ty, class TFn>
+  std::span<const EntityId> spawn_n(size_t count, TFn&& generator);
+
+  // remove the entity and all of its components, its slot is recycled with a bumped generation.
+  // Returns false for stale handles.
+  bool destroy(EntityId eid);
+
+  // bulk destruction, grouped by archetype like the other batch variants. Stale handles are skipped.
+  void destroy_n(std::span<const EntityId> eids);
+
+  bool alive(EntityId eid) const;
+
+  size_t entity_count() const { return entity_records.size() - _free_slots.size(); }
+
+  // Global change counter. Structural changes and passes of queries with non-const components
+  // stamp the chunks they write with a fresh tick, remember this value and hand it to
+  // Query::changed_since() to only revisit what was written afterwards.
+  uint64_t change_tick() const { return _change_tick.load(std::memory_order_relaxed); }
+
+  WorldStats stats() const;
+
+  // give slack memory back: trailing column chunks, vector capacity and cached move mappings.
+  // Columns are always dense, so there is nothing to defragment inside a chunk.
+  void compact();
 
+  // queries are backed by a persistent per-signature cache, so a query object can be kept for the
+  // whole run and still sees archetypes created after it.
   template <class... Ty>
   Query<Ty...> query();
 
+  template <class... Ty>
+  QueryCache& query_cache();
+
+  QueryCache& query_cache(Signature const& with, Signature const& without);
+
   template <class... Tys>
-  void set_components(Id eid, Tys&&... value);
+  void set_components(EntityId eid, Tys&&... value);
 
   template <class... Tys>
-  void add_components(Id eid, Tys&&... value);
+  void add_components(EntityId eid, Tys&&... value);
 
   template <class... Tys>
-  void del_components(Id eid);
+  void del_components(EntityId eid);
 
+  // batch variants: entities are grouped by source archetype and each group is migrated with a
+  // single Table::move_n, new components are initialized from `value`.
   template <class... Tys>
-  void has_components(Id eid);
+  void add_components_n(std::span<const EntityId> eids, Tys const&... value);
 
   template <class... Tys>
-  std::tuple<Tys&...> get_components(Id eid);
+  void del_components_n(std::span<const EntityId> eids);
+
+  template <class... Tys>
+  void has_components(EntityId eid);
+
+  template <class... Tys>
+  std::tuple<Tys&...> get_components(EntityId eid);
 
  public:
   template <class... Tys>
@@ -368,12 +688,34 @@ struct World {
   Archetype& deduce_archetype();
 
  public:
-  Map<Id, Archetype&> entity_records;
+  // sparse half of the entity sparse set, Table::col2id is the dense half
+  std::vector<EntityRecord> entity_records;
+
+  Map<Signature, Archetype&, Signature::hash_t> tag_records;
 
-  Map<Tag, Archetype&, utils::vec_hash_t<Tag>, utils::vec_equal_t<Tag>> tag_records;
+  // (with, without) -> cache
+  Map<std::pair<Signature, Signature>, QueryCache, utils::pair_hash_t<Signature::hash_t>> query_caches;
 
  private:
-  void _move_entity(Id eid, Archetype& src_archetype, Archetype& dst_archetype);
+  void _register_archetype(Signature const& arch_sig, Archetype& archetype);
+
+  EntityRecord& _record(EntityId eid);
+
+  // take a free slot or append a new one, the archetype of the record is left unset
+  EntityId _create_entity();
+
+  // grab `count` slots for spawn_n, recycled ones first
+  void _create_entities(size_t count, std::vector<EntityId>& eids);
+
+  void _release_entity(EntityId eid);
+
+  void _move_entity(EntityId eid, Archetype& src_archetype, Archetype& dst_archetype);
+
+  void _move_entities(std::span<const EntityId> eids, Archetype& src_archetype, Archetype& dst_archetype);
+
+  // split `eids` into runs sharing the same source archetype and call func(src_archetype, run)
+  template <class TFn>
+  void _for_each_archetype_group(std::span<const EntityId> eids, TFn&& func);
 
   template <class Ty>
   Archetype& _add_one_type(Archetype& src_archetype);
@@ -382,18 +724,35 @@ struct World {
   Archetype& _del_one_type(Archetype& src_archetype);
 
  private:
-  Id _next_entity_id{0};
+  Id _next_table_id{0};
 
-  Map<Id, Entity> _entities;
+  std::vector<uint32_t> _free_slots;
+
+  std::atomic<uint64_t> _change_tick{0};
+
+  uint64_t _advance_tick() { return _change_tick.fetch_add(1, std::memory_order_relaxed) + 1; }
 
   Map<Id, Archetype> _archetypes;
 
-  //  archetype_id, component_id, archetype_ref
-  Map<Id, Map<Id, Archetype&>> archetype_graph;
+  // empty archetype every new entity starts from, it owns no entity and is never queried
+  Archetype _root_archetype{std::numeric_limits<Id>::max(), this};
+
+  //  (archetype_id, component_set_id, is_add_or_del) -> archetype_ref
+  Map<uint64_t, Archetype&> archetype_graph;
+
+  template <bool is_add_or_del, class... Ty>
+  static uint64_t _edge_key(Id tid);
 
  public:
   template <class... Tys>
-  static Tag tag(Tag const& exist_tag);
+  static Signature tag(Signature exist_tag = {});
+
+  template <class... Tys>
+  static Signature untag(Signature exist_tag);
+
+  // id of an ordered component set, used to key archetype_graph edges
+  template <class... Tys>
+  static Id get_set_id();
 
   template <class Ty>
   static Id get_id();
@@ -403,11 +762,16 @@ struct World {
 
   template <class Ty>
   inline static Id _type_idx_val = _next_type_idx++;
+
+  inline static Id _next_set_idx = 0;
+
+  template <class... Ty>
+  inline static Id _set_idx_val = _next_set_idx++;
 };
 
 #pragma region ECS_ENTITY_IMPL
 
-inline Entity::Entity(Id eid, World* world) : eid(eid), world(world) {}
+inline Entity::Entity(EntityId eid, World* world) : eid(eid), world(world) {}
 
 template <class... Tys>
 Entity& Entity::set(Tys&&... args) {
@@ -432,22 +796,45 @@ Entity& Entity::del() {
   return *this;
 }
 
+inline bool Entity::alive() const { return world->alive(eid); }
+
+inline void Entity::destroy() { world->destroy(eid); }
+
 #pragma endregion
 
 #pragma region ECS_WORLD_IMPL
 
 template <class... Tys>
-inline Tag World::tag(Tag const& exist_tag) {
-  Tag&& new_tag = {get_id<Tys>()...};
-  new_tag.insert(new_tag.end(), exist_tag.begin(), exist_tag.end());
-  std::sort(new_tag.begin(), new_tag.end());
-  new_tag.erase(std::unique(new_tag.begin(), new_tag.end()), new_tag.end());
-  return new_tag;
+inline Signature World::tag(Signature exist_tag) {
+  (exist_tag.set(get_id<Tys>()), ...);
+  return exist_tag;
 }
 
+template <class... Tys>
+inline Signature World::untag(Signature exist_tag) {
+  (exist_tag.reset(get_id<Tys>()), ...);
+  return exist_tag;
+}
+
+// `const Ty` shares the id of `Ty`, constness only marks read access in queries
 template <class Ty>
 inline Id World::get_id() {
-  return _type_idx_val<Ty>;
+  const auto id = _type_idx_val<std::remove_cvref_t<Ty>>;
+  // checked in every build: a wrapped id would alias another component's signature bit
+  if (id >= Signature::max_components) [[unlikely]] {
+    throw std::length_error("too many component types, raise Signature::max_components");
+  }
+  return id;
+}
+
+template <class... Tys>
+inline Id World::get_set_id() {
+  return _set_idx_val<Tys...>;
+}
+
+template <bool is_add_or_del, class... Ty>
+inline uint64_t World::_edge_key(Id tid) {
+  return (uint64_t(tid) << 32) | (uint64_t(get_set_id<Ty...>()) << 1) | uint64_t(is_add_or_del);
 }
 
 template <class... Tys>
@@ -456,8 +843,30 @@ inline Query<Tys...> World::query() {
 }
 
 template <class... Tys>
-void World::set_components(Id eid, Tys&&... args) {
-  auto& archetype = entity_records.at(eid);
+inline QueryCache& World::query_cache() {
+  return query_cache(tag<Tys...>(), {});
+}
+
+inline QueryCache& World::query_cache(Signature const& with, Signature const& without) {
+  auto cache_iter = query_caches.find({with, without});
+  if (cache_iter != query_caches.end()) return cache_iter->second;
+
+  auto& cache = query_caches.emplace(std::make_pair(with, without), QueryCache{.with = with, .without = without, .tables = {}}).first->second;
+  for (auto& [arch_sig, archetype] : tag_records) {
+    if (cache.match(arch_sig)) cache.tables.emplace_back(&archetype);
+  }
+  return cache;
+}
+
+void inline World::_register_archetype(Signature const& arch_sig, Archetype& archetype) {
+  for (auto& [query_key, cache] : query_caches) {
+    if (cache.match(arch_sig)) cache.tables.emplace_back(&archetype);
+  }
+}
+
+template <class... Tys>
+void World::set_components(EntityId eid, Tys&&... args) {
+  auto& archetype = *_record(eid).archetype;
   if (archetype.has<Tys...>()) {
     archetype.set<Tys...>(eid, std::forward<Tys>(args)...);
   } else {
@@ -466,33 +875,72 @@ void World::set_components(Id eid, Tys&&... args) {
 }
 
 template <class... Tys>
-std::tuple<Tys&...> World::get_components(Id eid) {
-  auto& archetype = entity_records.at(eid);
+std::tuple<Tys&...> World::get_components(EntityId eid) {
+  auto& archetype = *_record(eid).archetype;
   return archetype.at<Tys...>(eid);
 }
 
 template <class... Tys>
-void World::add_components(Id eid, Tys&&... args) {
-  Archetype& old_table = entity_records.at(eid);
+void World::add_components(EntityId eid, Tys&&... args) {
+  Archetype& old_table = *_record(eid).archetype;
   Archetype& new_table = add_to_archetype<Tys...>(old_table);
 
   if (&old_table != &new_table) {
     _move_entity(eid, old_table, new_table);
-    entity_records.erase(eid);
-    entity_records.emplace(eid, new_table);
   }
   new_table.set(eid, std::forward<Tys>(args)...);
 }
 
 template <class... Tys>
-void World::del_components(Id eid) {
-  Archetype& old_table = entity_records.at(eid);
+void World::del_components(EntityId eid) {
+  Archetype& old_table = *_record(eid).archetype;
   Archetype& new_table = del_from_archetype<Tys...>(old_table);
 
   if (&old_table != &new_table) {
     _move_entity(eid, old_table, new_table);
-    entity_records.erase(eid);
-    entity_records.emplace(eid, new_table);
+  }
+}
+
+template <class... Tys>
+void World::add_components_n(std::span<const EntityId> eids, Tys const&... value) {
+  _for_each_archetype_group(eids, [&](Archetype& old_table, std::span<const EntityId> group) {
+    Archetype& new_table = add_to_archetype<Tys...>(old_table);
+    if (&old_table != &new_table) {
+      _move_entities(group, old_table, new_table);
+      (new_table.typed_row<Tys>().reserve(new_table.cols()), ...);
+    }
+    for (auto eid : group) {
+      new_table.set(eid, Tys(value)...);
+    }
+  });
+}
+
+template <class... Tys>
+void World::del_components_n(std::span<const EntityId> eids) {
+  _for_each_archetype_group(eids, [&](Archetype& old_table, std::span<const EntityId> group) {
+    Archetype& new_table = del_from_archetype<Tys...>(old_table);
+    if (&old_table != &new_table) {
+      _move_entities(group, old_table, new_table);
+    }
+  });
+}
+
+template <class TFn>
+void World::_for_each_archetype_group(std::span<const EntityId> eids, TFn&& func) {
+  std::vector<std::pair<Archetype*, EntityId>> records;
+  records.reserve(eids.size());
+  for (auto eid : eids) {
+    records.emplace_back(_record(eid).archetype, eid);
+  }
+  std::stable_sort(records.begin(), records.end(), [](auto const& lhs, auto const& rhs) { return lhs.first < rhs.first; });
+
+  std::vector<EntityId> group;
+  for (size_t begin = 0, end = 0; begin < records.size(); begin = end) {
+    group.clear();
+    for (end = begin; end < records.size() && records[end].first == records[begin].first; ++end) {
+      group.emplace_back(records[end].second);
+    }
+    func(*records[begin].first, std::span<const EntityId>(group));
   }
 }
 
@@ -508,174 +956,487 @@ Archetype& World::del_from_archetype(Archetype const& src_archetype) {
 
 template <bool is_add_or_del, class... Ty>
 Archetype& World::deduce_archetype(Archetype const& src_archetype) {
-  auto&& new_tag = tag<Ty...>(src_archetype.unsort_tag());
+  // fast path: this transition happened before, follow the cached graph edge
+  const auto edge = _edge_key<is_add_or_del, Ty...>(src_archetype.tid);
+  if (auto edge_iter = archetype_graph.find(edge); edge_iter != archetype_graph.end()) {
+    return edge_iter->second;
+  }
+
+  auto new_tag = is_add_or_del ? tag<Ty...>(src_archetype.signature()) : untag<Ty...>(src_archetype.signature());
   auto table_iter = tag_records.find(new_tag);
 
   if (table_iter == tag_records.end()) {
-    auto tid = _next_entity_id++;
+    auto tid = _next_table_id++;
     auto emplace_iter = _archetypes.emplace(tid, Table::creator<is_add_or_del, Ty...>(tid, src_archetype));
 
     assert(emplace_iter.second && "emplace new archetype failed.");
     auto& new_archetype = emplace_iter.first->second;
     tag_records.emplace(new_tag, new_archetype);
-    return new_archetype;
+    _register_archetype(new_tag, new_archetype);
+    table_iter = tag_records.find(new_tag);
   }
 
+  archetype_graph.emplace(edge, table_iter->second);
   return table_iter->second;
 }
 
 template <class... Ty>
-inline Entity& World::entity() {
+inline Entity World::entity() {
   static_assert((... && std::is_default_constructible_v<Ty>));
 
-  auto eid = _next_entity_id++;
-  Entity new_entity(eid, this);
-
-  auto& dst_archetype = deduce_archetype<true, Ty...>({});
+  auto eid = _create_entity();
+  auto& dst_archetype = deduce_archetype<true, Ty...>(_root_archetype);
   dst_archetype.add(eid);
+  return Entity(eid, this);
+}
 
-  entity_records.emplace(eid, dst_archetype);
-  auto p = _entities.emplace(eid, std::move(new_entity));
+template <class... Ty>
+inline Entity World::entity(Ty&&... args) {
+  auto eid = _create_entity();
+  auto& dst_archetype = deduce_archetype<true, Ty...>(_root_archetype);
+  dst_archetype.add(eid, std::forward<Ty>(args)...);
+  return Entity(eid, this);
+}
 
-  return p.first->second;
+template <class... Ty, class TFn>
+inline std::span<const EntityId> World::spawn_n(size_t count, TFn&& generator) {
+  std::vector<EntityId> eids;
+  _create_entities(count, eids);
+
+  auto& dst_archetype = deduce_archetype<true, Ty...>(_root_archetype);
+  auto first_col = dst_archetype.cols();
+  try {
+    dst_archetype.template add_n<Ty...>(eids, generator);
+  } catch (...) {
+    for (auto eid : eids) _release_entity(eid);
+    throw;
+  }
+  return std::span<const EntityId>(dst_archetype.entities()).subspan(first_col);
 }
 
-template <class... Ty>
-inline Entity& World::entity(Ty&&... args) {
-  auto eid = _next_entity_id++;
-  Entity new_entity(eid, this);
+inline bool World::alive(EntityId eid) const {
+  auto index = entity_index(eid);
+  return index < entity_records.size() && entity_records[index].archetype && entity_records[index].generation == entity_generation(eid);
+}
 
-  auto& dst_archetype = deduce_archetype<true, Ty...>({});
-  dst_archetype.add(eid, std::forward<Ty>(args)...);
+inline EntityRecord& World::_record(EntityId eid) {
+  assert(alive(eid) && "stale or invalid entity handle");
+  return entity_records[entity_index(eid)];
+}
+
+inline EntityId World::_create_entity() {
+  if (!_free_slots.empty()) {
+    auto index = _free_slots.back();
+    _free_slots.pop_back();
+    return make_entity_id(index, entity_records[index].generation);
+  }
+  assert(entity_records.size() < std::numeric_limits<uint32_t>::max());
+  entity_records.emplace_back();
+  return make_entity_id(uint32_t(entity_records.size() - 1), 0);
+}
+
+inline void World::_create_entities(size_t count, std::vector<EntityId>& eids) {
+  eids.reserve(eids.size() + count);
+  while (count > 0 && !_free_slots.empty()) {
+    eids.emplace_back(_create_entity());
+    --count;
+  }
+  assert(entity_records.size() + count < std::numeric_limits<uint32_t>::max());
+  auto first_index = uint32_t(entity_records.size());
+  entity_records.resize(entity_records.size() + count);
+  for (uint32_t i = 0; i < count; ++i) {
+    eids.emplace_back(make_entity_id(first_index + i, 0));
+  }
+}
 
-  entity_records.emplace(eid, dst_archetype);
-  auto p = _entities.emplace(eid, std::move(new_entity));
+inline void World::_release_entity(EntityId eid) {
+  auto& record = entity_records[entity_index(eid)];
+  record.archetype = nullptr;
+  record.col = 0;
+  ++record.generation;
+  _free_slots.emplace_back(entity_index(eid));
+}
 
-  return p.first->second;
+inline bool World::destroy(EntityId eid) {
+  if (!alive(eid)) return false;
+  _record(eid).archetype->del(eid);
+  _release_entity(eid);
+  return true;
 }
 
-void inline World::_move_entity(Id eid, Archetype& src_archetype, Archetype& dst_archetype) { src_archetype.move(eid, dst_archetype); }
+inline void World::destroy_n(std::span<const EntityId> eids) {
+  std::vector<EntityId> live;
+  live.reserve(eids.size());
+  for (auto eid : eids) {
+    if (alive(eid)) live.emplace_back(eid);
+  }
+  // a handle listed twice is only destroyed once
+  std::sort(live.begin(), live.end());
+  live.erase(std::unique(live.begin(), live.end()), live.end());
+
+  _for_each_archetype_group(live, [&](Archetype& archetype, std::span<const EntityId> group) { archetype.del_n(group); });
+  for (auto eid : live) _release_entity(eid);
+}
+
+void inline World::_move_entity(EntityId eid, Archetype& src_archetype, Archetype& dst_archetype) { src_archetype.move(eid, dst_archetype); }
+
+void inline World::_move_entities(std::span<const EntityId> eids, Archetype& src_archetype, Archetype& dst_archetype) { src_archetype.move_n(eids, dst_archetype); }
+
+inline WorldStats World::stats() const {
+  WorldStats result{};
+  result.entities = entity_count();
+  result.entity_slots = entity_records.size();
+  result.free_slots = _free_slots.size();
+  result.index_bytes = entity_records.capacity() * sizeof(EntityRecord) + _free_slots.capacity() * sizeof(uint32_t);
+  result.index_bytes += utils::map_bytes(_archetypes) + utils::map_bytes(tag_records) + utils::map_bytes(archetype_graph) + utils::map_bytes(query_caches);
+  for (auto const& [key, cache] : query_caches) result.index_bytes += cache.tables.capacity() * sizeof(Table*);
+
+  for (auto const& [tid, archetype] : _archetypes) {
+    auto& arch_stats = result.archetypes.emplace_back(archetype.stats());
+    result.column_used_bytes += arch_stats.used_bytes;
+    result.column_reserved_bytes += arch_stats.reserved_bytes;
+    result.index_bytes += arch_stats.index_bytes;
+  }
+  std::sort(result.archetypes.begin(), result.archetypes.end(), [](auto const& lhs, auto const& rhs) { return lhs.tid < rhs.tid; });
+  return result;
+}
+
+inline void World::compact() {
+  for (auto& [tid, archetype] : _archetypes) archetype.shrink_to_fit();
+  _root_archetype.shrink_to_fit();
+  entity_records.shrink_to_fit();
+  _free_slots.shrink_to_fit();
+  for (auto& [key, cache] : query_caches) cache.tables.shrink_to_fit();
+}
 
 #pragma endregion
 
 #pragma region ECS_TABLE_IMPL
 
-void inline Table::_move_elemt(Table& src_table, size_t src_row, size_t src_col, Table& dst_table, size_t dst_row, size_t dst_col) {
-  src_table.data[src_row]->move(src_col, *dst_table.data[dst_row], dst_col);
+void inline Table::_move_elemt(Table& src_table, size_t src_row, size_t src_col, Table& dst_table, size_t dst_row, [[maybe_unused]] size_t dst_col) {
+  assert(dst_table.data[dst_row].size() == dst_col);
+  dst_table.data[dst_row].relocate_back(src_table.data[src_row], src_col);
+  src_table.data[src_row].erase_relocated(src_col);
+}
+
+inline std::vector<size_t> const& Table::_row_mapping(Table const& dst_table) {
+  auto mapping_iter = move_mappings.find(dst_table.tid);
+  if (mapping_iter != move_mappings.end()) return mapping_iter->second;
+
+  std::vector<size_t> mapping(rows(), std::numeric_limits<size_t>::max());
+  for (size_t src_row = 0; src_row < rows(); ++src_row) {
+    auto p = dst_table.id2row.find(row2id[src_row]);
+    if (p != dst_table.id2row.end()) mapping[src_row] = p->second;
+  }
+  return move_mappings.emplace(dst_table.tid, std::move(mapping)).first->second;
 }
 
-void inline Table::move(Id id, Table& dst_table) {
+inline size_t Table::_detach(EntityId eid) {
+  auto col = world->_record(eid).col;
+  auto last_col = cols() - 1;
+  auto last_eid = col2id[last_col];
+
+  world->entity_records[entity_index(last_eid)].col = uint32_t(col);
+  col2id[col] = last_eid;
+  col2id.pop_back();
+  return col;
+}
+
+inline void Table::_attach(EntityId eid) {
+  assert(cols() < std::numeric_limits<uint32_t>::max());
+  auto& record = world->entity_records[entity_index(eid)];
+  record.archetype = this;
+  record.col = uint32_t(cols());
+  col2id.emplace_back(eid);
+}
+
+void inline Table::move(EntityId eid, Table& dst_table) {
   if (this == &dst_table) return;
+  assert(has(eid));
 
-  size_t src_col = id2col[id];
-  size_t dst_col = 0;
+  auto const& mapping = _row_mapping(dst_table);
+  auto src_col = _detach(eid);
+  auto dst_col = dst_table.cols();
+  dst_table._attach(eid);
 
-  if (!dst_table.id2col.contains(id)) {
-    dst_col = dst_table.cols();
-    dst_table.id2col.emplace(id, dst_table.cols());
-    dst_table.col2id.emplace_back(id);
-  } else {
-    dst_col = dst_table.id2col[id];
+  for (size_t src_row = 0; src_row < rows(); ++src_row) {
+    if (mapping[src_row] != std::numeric_limits<size_t>::max()) {
+      Table::_move_elemt(*this, src_row, src_col, dst_table, mapping[src_row], dst_col);
+    } else {
+      data[src_row].swap_remove(src_col);
+    }
+  }
+
+  auto tick = world->_advance_tick();
+  _touch(src_col, tick);
+  dst_table._touch(dst_col, tick);
+}
+
+void inline Table::move_n(std::span<const EntityId> eids, Table& dst_table) {
+  if (this == &dst_table || eids.empty()) return;
+
+  auto const& mapping = _row_mapping(dst_table);
+
+  // replay the swap_end removals on the index first, every column then follows the same sequence
+  std::vector<size_t> src_cols;
+  src_cols.reserve(eids.size());
+  const auto first_dst_col = dst_table.cols();
+  dst_table.col2id.reserve(dst_table.cols() + eids.size());
+  for (auto eid : eids) {
+    assert(has(eid));
+    src_cols.emplace_back(_detach(eid));
+    dst_table._attach(eid);
   }
 
   for (size_t src_row = 0; src_row < rows(); ++src_row) {
-    auto id_row = row2id[src_row];
-    auto p = dst_table.id2row.find(id_row);
-    if (p != dst_table.id2row.end()) {
-      Table::_move_elemt(*this, src_row, src_col, dst_table, p->second, dst_col);
+    auto& src_column = data[src_row];
+    if (mapping[src_row] != std::numeric_limits<size_t>::max()) {
+      auto& dst_column = dst_table.data[mapping[src_row]];
+      dst_column.reserve(dst_column.size() + src_cols.size());
+      for (auto src_col : src_cols) {
+        dst_column.relocate_back(src_column, src_col);
+        src_column.erase_relocated(src_col);
+      }
+    } else {
+      for (auto src_col : src_cols) src_column.swap_remove(src_col);
     }
   }
-  // delete moved element
-  del(id);
+
+  auto tick = world->_advance_tick();
+  for (auto src_col : src_cols) _touch(src_col, tick);
+  for (size_t c = first_dst_col; c < dst_table.cols(); c += data::Column::chunk_size - (c & data::Column::chunk_mask)) dst_table._touch(c, tick);
 }
 
-inline bool Table::ready() const { return data.size() == rows(); }
+inline void Table::permute(std::span<const uint32_t> order) {
+  assert(order.size() == cols());
+  const auto count = cols();
+  std::vector<data::Column> sorted;
+  sorted.reserve(rows());
+  for (auto& column : data) {
+    sorted.emplace_back(column.create_mimic());
+    sorted.back().extend_uninitialized(count);
+  }
+  std::vector<EntityId> sorted_ids(count);
+
+  const auto chunks = (count + data::Column::chunk_mask) >> data::Column::chunk_bits;
+  tbb::parallel_for(size_t(0), chunks, [&](size_t c) {
+    const auto begin = c << data::Column::chunk_bits;
+    const auto end = std::min(count, begin + data::Column::chunk_size);
+    for (size_t ri = 0; ri < rows(); ++ri) sorted[ri].gather_relocated(data[ri], order, begin, end);
+    for (auto col = begin; col < end; ++col) {
+      sorted_ids[col] = col2id[order[col]];
+      world->entity_records[entity_index(sorted_ids[col])].col = uint32_t(col);
+    }
+  });
 
-inline data::IStorage& Table::row(size_t idx) const {
-  // TODO: insert return statement here
-  return *data[idx];
+  for (size_t ri = 0; ri < rows(); ++ri) {
+    data[ri].release_relocated();
+    data[ri] = std::move(sorted[ri]);
+  }
+  col2id.swap(sorted_ids);
+
+  auto tick = world->_advance_tick();
+  for (size_t c = 0; c < count; c += data::Column::chunk_size) _touch(c, tick);
+}
+
+inline ArchetypeStats Table::stats() const {
+  ArchetypeStats result{.tid = tid, .signature = components, .entities = cols(), .columns = {}, .used_bytes = 0, .reserved_bytes = 0, .index_bytes = 0};
+  for (size_t ri = 0; ri < rows(); ++ri) {
+    auto const& column = data[ri];
+    result.columns.push_back({.component = row2id[ri],
+                              .element_bytes = column.type().size,
+                              .size = column.size(),
+                              .capacity = column.capacity(),
+                              .used_bytes = column.used_bytes(),
+                              .reserved_bytes = column.reserved_bytes()});
+    result.used_bytes += column.used_bytes();
+    result.reserved_bytes += column.reserved_bytes();
+  }
+  result.index_bytes = col2id.capacity() * sizeof(EntityId) + row2id.capacity() * sizeof(Id) + utils::map_bytes(id2row) + utils::map_bytes(move_mappings);
+  for (auto const& [dst_tid, mapping] : move_mappings) result.index_bytes += mapping.capacity() * sizeof(size_t);
+  return result;
+}
+
+inline void Table::shrink_to_fit() {
+  for (auto& column : data) column.shrink_to_fit();
+  col2id.shrink_to_fit();
+  // mappings are rebuilt on the next move to that archetype
+  move_mappings.clear();
 }
 
+inline void Table::_touch(size_t col, uint64_t tick) {
+  for (auto& column : data) {
+    if (col < column.size()) column.touch(col, tick);
+  }
+}
+
+inline bool Table::ready() const { return data.size() == rows(); }
+
+inline data::Column& Table::row(size_t idx) { return data[idx]; }
+
+inline data::Column const& Table::row(size_t idx) const { return data[idx]; }
+
 template <class Ty>
-data::Array<Ty>& Table::row() const {
+data::Column& Table::row() {
   return typed_row<Ty>();
 }
 
-inline bool Table::has(Id id) const { return id2col.contains(id); }
+inline bool Table::has(EntityId eid) const { return world->alive(eid) && world->entity_records[entity_index(eid)].archetype == this; }
 
 template <class... Ty>
 bool Table::has() const {
-  return (id2row.contains(World::get_id<Ty>()) && ...);
+  return (components.test(World::get_id<Ty>()) && ...);
 }
 
-void inline Table::del(Id id) {
+void inline Table::del(EntityId eid) {
   // swap_end & delete implementation
-  auto col = id2col[id];  // throw exception if not found
-  auto last_col = cols() - 1;
-  auto last_id = col2id[last_col];
-
+  assert(has(eid));
+  auto col = _detach(eid);
   for (size_t i = 0; i < rows(); ++i) {
-    data[i]->swap(col, cols() - 1);
-    data[i]->shrink_one();
+    data[i].swap_remove(col);
   }
-  std::swap(id2col[id], id2col[last_id]);
-  std::swap(col2id[col], col2id[last_col]);
-  id2col.erase(id);
-  col2id.pop_back();
+  _touch(col, world->_advance_tick());
+}
+
+void inline Table::del_n(std::span<const EntityId> eids) {
+  std::vector<size_t> del_cols;
+  del_cols.reserve(eids.size());
+  for (auto eid : eids) {
+    assert(has(eid));
+    del_cols.emplace_back(_detach(eid));
+  }
+  for (auto& column : data) {
+    for (auto col : del_cols) column.swap_remove(col);
+  }
+  auto tick = world->_advance_tick();
+  for (auto col : del_cols) _touch(col, tick);
 }
 
 template <class... Ty>
-void Table::add(Id id, Ty&&... val) {
-  assert(!id2col.contains(id));
-  id2col.emplace(id, cols());
-  col2id.emplace_back(id);
-  (typed_row<Ty>().append(val), ...);
+void Table::add(EntityId eid, Ty&&... val) {
+  _attach(eid);
+  (typed_row<Ty>().template emplace_back<Ty>(std::forward<Ty>(val)), ...);
   _append_empty_if_needed();
+  _touch(cols() - 1, world->_advance_tick());
+}
+
+template <class... Ty, class TFn>
+void Table::add_n(std::span<const EntityId> eids, TFn&& generator) {
+  assert(sizeof...(Ty) == rows() && has<Ty...>());
+  assert(cols() + eids.size() < std::numeric_limits<uint32_t>::max());
+  auto first_col = cols();
+  auto count = eids.size();
+  auto columns = std::forward_as_tuple(typed_row<Ty>()...);
+  // allocate up front: elements are built past the end of the columns, which only grow once all of
+  // them succeeded
+  std::apply([&](auto&... column) { (column.reserve(first_col + count), ...); }, columns);
+  col2id.reserve(first_col + count);
+
+  auto destroy_elemt = [&](size_t i, size_t built) {
+    std::apply(
+        [&](auto&... column) {
+          size_t c = 0;
+          ((c++ < built ? column.type().destroy(column[first_col + i], 1) : void()), ...);
+        },
+        columns);
+  };
+  auto build = [&]<size_t... I>(std::index_sequence<I...>, size_t i) {
+    size_t built = 0;
+    try {
+      auto&& values = generator(i);
+      ((new (std::get<I>(columns)[first_col + i]) Ty(std::move(std::get<I>(values))), ++built), ...);
+    } catch (...) {
+      destroy_elemt(i, built);
+      throw;
+    }
+  };
+
+  // A throwing generator or constructor must not cancel the other ranges, since the finished ones
+  // could not be told apart afterwards. A failing range destroys its own elements and is recorded.
+  std::mutex failed_mutex;
+  std::vector<std::pair<size_t, size_t>> failed;
+  std::exception_ptr error;
+  auto fill = [&](size_t begin, size_t end) {
+    size_t i = begin;
+    try {
+      for (; i < end; ++i) build(std::index_sequence_for<Ty...>{}, i);
+    } catch (...) {
+      for (size_t j = begin; j < i; ++j) destroy_elemt(j, sizeof...(Ty));
+      std::lock_guard lock(failed_mutex);
+      failed.emplace_back(begin, end);
+      if (!error) error = std::current_exception();
+    }
+  };
+
+  tbb::parallel_invoke(
+      [&]() {
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, count, data::Column::chunk_size),
+                          [&](tbb::blocked_range<size_t> const& range) { fill(range.begin(), range.end()); });
+      },
+      [&]() {
+        col2id.insert(col2id.end(), eids.begin(), eids.end());
+        for (size_t i = 0; i < count; ++i) {
+          world->entity_records[entity_index(eids[i])] = {.archetype = this, .col = uint32_t(first_col + i), .generation = entity_generation(eids[i])};
+        }
+      });
+
+  if (error) {
+    // roll back: the table is left as it was, the caller still owns `eids` and releases their records
+    std::sort(failed.begin(), failed.end());
+    size_t i = 0;
+    for (auto [begin, end] : failed) {
+      for (; i < begin; ++i) destroy_elemt(i, sizeof...(Ty));
+      i = end;
+    }
+    for (; i < count; ++i) destroy_elemt(i, sizeof...(Ty));
+    col2id.resize(first_col);
+    std::rethrow_exception(error);
+  }
+
+  std::apply([count](auto&... column) { (column.extend_uninitialized(count), ...); }, columns);
+  auto tick = world->_advance_tick();
+  for (size_t c = first_col; c < cols(); c += data::Column::chunk_size - (c & data::Column::chunk_mask)) _touch(c, tick);
 }
 
 template <class... Ty>
-void Table::set(Id id, Ty&&... val) {
-  auto col_iter = id2col.find(id);
-  if (col_iter == id2col.end()) {
-    return add(id, std::forward<Ty>(val)...);
+void Table::set(EntityId eid, Ty&&... val) {
+  if (!has(eid)) {
+    return add(eid, std::forward<Ty>(val)...);
   }
-  (([this, &col_iter]<class T>(T&& val) {
-     auto& col = col_iter->second;
+  const auto tick = world->_advance_tick();
+  (([this, tick, col = size_t(world->_record(eid).col)]<class T>(T&& val) {
      auto& data_row = typed_row<Ty>();
      if (data_row.size() > col) {
-       data_row.at(col) = std::forward<Ty>(val);
+       data_row.template at<Ty>(col) = std::forward<Ty>(val);
      } else {
        assert(data_row.size() == col);
        // Here the append is needed to add this component, because this entity is partially
        // initialized by outside moving.
-       data_row.append(std::forward<Ty>(val));
+       data_row.template emplace_back<Ty>(std::forward<Ty>(val));
      }
+     data_row.touch(col, tick);
    }(std::forward<Ty>(val))),
    ...);
 }
 
 template <class... Ty>
-std::tuple<Ty&...> Table::at(Id id) {
-  auto col = id2col.at(id);
-  return std::forward_as_tuple(typed_row<Ty>().at(col)...);
+std::tuple<Ty&...> Table::at(EntityId eid) {
+  assert(has(eid));
+  auto col = world->_record(eid).col;
+  return std::forward_as_tuple(typed_row<Ty>().template at<Ty>(col)...);
 }
 
 void inline Table::_append_empty_if_needed() {
   for (auto& row : data) {
-    while (row->size() < cols()) {
-      row->extend_one();
+    while (row.size() < cols()) {
+      row.extend_one();
     }
   }
 }
 
 template <class Ty>
-data::Array<Ty>& Table::typed_row() const {
-  return _typed_row<Ty>(id2row.at(World::get_id<Ty>()));
-}
-
-template <class Ty>
-data::Array<Ty>& Table::_typed_row(size_t row) const {
-  return *utils::down_cast<data::Array<Ty>>(data[row]);
+data::Column& Table::typed_row() {
+  return data[id2row.at(World::get_id<Ty>())];
 }
 
 template <class... Ty>
@@ -686,9 +1447,10 @@ inline void Table::add_rows() {
 template <class Ty>
 inline void Table::_add_row() {
   auto id = World::get_id<Ty>();
-  data.emplace_back(new data::Array<Ty>());
+  data.emplace_back(data::Column::create<Ty>());
   id2row.emplace(id, rows());
   row2id.emplace_back(id);
+  components.set(id);
 }
 
 template <class... Ty>
@@ -708,11 +1470,11 @@ inline void Table::_del_row() {
   id2row.erase(id);
 
   std::swap(data[row], data[last_row]);
-  delete data.back();
   data.pop_back();
 
   std::swap(row2id[row], row2id[last_row]);
   row2id.pop_back();
+  components.reset(id);
 }
 
 inline Table::Table(Id tid, World* world) : tid(tid), world(world) {}
@@ -736,17 +1498,12 @@ inline Table Table::creator(Id tid, Table const& src_table) {
   return new_table;
 }
 
-inline Table::~Table() {
-  for (auto ptr : data) {
-    delete ptr;
-  }
-}
-
 void inline Table::mimic_rows(Table const& src_table) {
   if (!data.empty()) return;
 
   row2id = src_table.row2id;
   id2row = src_table.id2row;
+  components = src_table.components;
 
   for (size_t ri = 0; ri < src_table.rows(); ++ri) {
     data.emplace_back(src_table.row(ri).create_mimic());
@@ -757,10 +1514,7 @@ void inline Table::mimic_rows(Table const& src_table) {
 
 template <class... Ty, class TFn>
 inline void Table::for_each_col(TFn&& func) {
-  auto&& data_rows = std::forward_as_tuple(typed_row<Ty>()...);
-  for (size_t col = 0; col < cols(); ++col) {
-    std::apply([col, func](auto&&... data_row) { func(data_row[col]...); }, data_rows);
-  }
+  TableView<Ty...>(*this).for_each(std::forward<TFn>(func), {.since = 0, .tick = world->_advance_tick()});
 }
 
 #else
@@ -768,17 +1522,12 @@ inline void Table::for_each_col(TFn&& func) {
 template <class... Ty, class TFn>
 inline void Table::for_each_col(TFn&& func) {
   for (size_t col = 0; col < cols(); ++col) {
-    func(*static_cast<Ty*>(row(id2col[world->get_id<Ty>()])[col])...);
+    func(*static_cast<Ty*>(row(id2row.at(world->get_id<Ty>()))[col])...);
   }
 }
 
 #endif
 
-template <class Ty>
-inline std::vector<Ty>& Table::get_row() {
-  return this->typed_row<Ty>().inner_array;
-}
-
 #pragma endregion
 
 #pragma region Type_Array_Impl
@@ -794,22 +1543,149 @@ Query<Ty...>::Query(World* world) : world(world) {
 
 template <class... Ty>
 void Query<Ty...>::initialize() {
-  const auto tag = world->tag<Ty...>({});
-  for (auto& [arch_tag, archetype] : world->tag_records) {
-    if (std::includes(arch_tag.begin(), arch_tag.end(), tag.begin(), tag.end())) {
-      views.emplace_back(archetype);
-    }
+  cache = &world->query_cache<Ty...>();
+  views.clear();
+  _sync_views();
+}
+
+template <class... Ty>
+template <class... Tys>
+Query<Ty...>& Query<Ty...>::with() {
+  cache = &world->query_cache(World::tag<Tys...>(cache->with), cache->without);
+  views.clear();
+  _sync_views();
+  return *this;
+}
+
+template <class... Ty>
+template <class... Tys>
+Query<Ty...>& Query<Ty...>::without() {
+  cache = &world->query_cache(cache->with, World::tag<Tys...>(cache->without));
+  views.clear();
+  _sync_views();
+  return *this;
+}
+
+template <class... Ty>
+void Query<Ty...>::_sync_views() {
+  while (views.size() < cache->tables.size()) {
+    views.emplace_back(*cache->tables[views.size()]);
   }
 }
 
 template <class... Ty>
 template <class TFunc>
 void Query<Ty...>::for_each(TFunc&& func) {
+  _sync_views();
+  const auto filter = _filter();
   for (auto& view : views) {
-    view.for_each(std::forward<TFunc>(func));
+    view.for_each(std::forward<TFunc>(func), filter);
   }
 }
 
+template <class... Ty>
+template <class TFunc>
+void Query<Ty...>::for_each_batch(TFunc&& func) {
+  _sync_views();
+  const auto filter = _filter();
+  for (auto& view : views) {
+    view.for_each_batch(std::forward<TFunc>(func), filter);
+  }
+}
+
+template <class... Ty>
+template <class TFunc>
+void Query<Ty...>::for_each_entity(TFunc&& func) {
+  _sync_views();
+  const auto filter = _filter();
+  for (auto& view : views) {
+    view.for_each_entity(std::forward<TFunc>(func), filter);
+  }
+}
+
+template <class... Ty>
+Query<Ty...>& Query<Ty...>::changed_since(uint64_t tick) {
+  since = tick;
+  return *this;
+}
+
+template <class... Ty>
+ChunkFilter Query<Ty...>::_filter() {
+  constexpr bool is_mutable = (!std::is_const_v<Ty> || ...);
+  return {.since = since, .tick = is_mutable ? world->_advance_tick() : 0};
+}
+
+template <class... Ty>
+Query<Ty...>& Query<Ty...>::grain(size_t rows) {
+  grain_size = std::clamp<size_t>(rows, 1, data::Column::chunk_size);
+  return *this;
+}
+
+template <class... Ty>
+auto Query<Ty...>::_split_ranges(ChunkFilter const& filter) -> std::vector<Range> {
+  std::vector<Range> ranges;
+  for (size_t vi = 0; vi < views.size(); ++vi) {
+    const auto size = views[vi].size();
+    for (size_t c = 0; c < views[vi].chunk_count(); ++c) {
+      // the filter runs here, before the workers start, so stamps are written by one thread
+      if (!views[vi].visit(c, filter)) continue;
+      const auto chunk_end = std::min(size, (c + 1) << data::Column::chunk_bits);
+      for (size_t begin = c << data::Column::chunk_bits; begin < chunk_end;) {
+        auto end = std::min(chunk_end, begin + grain_size);
+        ranges.push_back({vi, begin, end});
+        begin = end;
+      }
+    }
+  }
+  return ranges;
+}
+
+template <class... Ty>
+template <class TFunc>
+void Query<Ty...>::_par_for_each_range(TFunc&& func) {
+  _sync_views();
+  auto ranges = _split_ranges(_filter());
+  // ranges of all matched archetypes go into one pool, idle workers steal from busy ones
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, ranges.size(), 1), [&](tbb::blocked_range<size_t> const& r) {
+    for (size_t ri = r.begin(); ri < r.end(); ++ri) {
+      auto [vi, begin, end] = ranges[ri];
+      func(views[vi], begin, end);
+    }
+  });
+}
+
+template <class... Ty>
+template <class TFunc>
+void Query<Ty...>::par_for_each_chunk(TFunc&& func) {
+  _par_for_each_range([&func](TableView<Ty...>& view, size_t begin, size_t end) {
+    auto offset = begin & data::Column::chunk_mask;
+    std::apply([&](auto*... data_row) { func(std::span<Ty>(data_row + offset, end - begin)...); }, view.chunk(begin >> data::Column::chunk_bits));
+  });
+}
+
+template <class... Ty>
+template <class TFunc>
+void Query<Ty...>::par_for_each(TFunc&& func) {
+  par_for_each_chunk([&func](std::span<Ty>... data_row) {
+    const auto rows = std::get<0>(std::forward_as_tuple(data_row...)).size();
+    for (size_t idx = 0; idx < rows; ++idx) func(data_row[idx]...);
+  });
+}
+
+template <class... Ty>
+template <class TFunc>
+void Query<Ty...>::par_for_each_entity(TFunc&& func) {
+  _par_for_each_range([&func](TableView<Ty...>& view, size_t begin, size_t end) {
+    auto offset = begin & data::Column::chunk_mask;
+    const auto* eids = view.table->entities().data() + begin;
+    std::apply(
+        [&](auto*... data_row) {
+          for (size_t idx = 0; idx < end - begin; ++idx) func(eids[idx], data_row[offset + idx]...);
+        },
+        view.chunk(begin >> data::Column::chunk_bits));
+  });
+}
+
 #pragma endregion
 
 }  // namespace ecs
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <tbb/task_group.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ecs/neo_ecs.hpp"
+
+namespace sim::ecs {
+
+// Components a system touches. Derived from its query signature: `const Ty` is a read and a plain
+// `Ty` is a write.
+struct SystemAccess {
+  Signature reads;
+  Signature writes;
+  // exclusive systems (structural changes, command buffer sync points) never overlap with others
+  bool exclusive{false};
+
+  template <class... Ty>
+  static SystemAccess of();
+
+  SystemAccess operator|(SystemAccess const& other) const { return {reads | other.reads, writes | other.writes, exclusive || other.exclusive}; }
+
+  bool conflicts(SystemAccess const& other) const {
+    return exclusive || other.exclusive || writes.intersects(other.reads | other.writes) || other.writes.intersects(reads);
+  }
+};
+
+// System registry on top of a World. run() executes every system once: two systems keep their
+// registration order when they conflict on a component, everything else may run at the same time
+// on the tbb worker pool. Systems are free to use par_for_each internally.
+struct Scheduler {
+ public:
+  using SystemId = size_t;
+
+  explicit Scheduler(World& world) : world(&world) {}
+
+  // `func(Query<Ty...>& query)`, the query is created once and kept for the lifetime of the system
+  template <class... Ty, class TFn>
+  SystemId add_system(std::string name, TFn&& func);
+
+  // same with extra accesses the query does not show, e.g. a second query or a diagnostics output
+  template <class... Ty, class TFn>
+  SystemId add_system(std::string name, SystemAccess extra, TFn&& func);
+
+  // `func(World& world)` runs alone, e.g. to apply command buffers or to spawn/destroy entities
+  template <class TFn>
+  SystemId add_exclusive(std::string name, TFn&& func);
+
+  // run `system` after `dependency` even when their accesses do not conflict
+  void add_dependency(SystemId system, SystemId dependency);
+
+  void run();
+
+  size_t size() const { return systems.size(); }
+
+  std::string const& name(SystemId id) const { return systems[id].name; }
+
+  // systems `id` waits for in the current graph
+  std::vector<SystemId> dependencies(SystemId id);
+
+ private:
+  struct System {
+    std::string name;
+    SystemAccess access;
+    std::function<void()> body;
+    std::vector<SystemId> after;
+  };
+
+  struct Node {
+    std::vector<SystemId> successors;
+    std::vector<SystemId> predecessors;
+  };
+
+  SystemId _add(std::string name, SystemAccess access, std::function<void()> body);
+
+  void _build_graph();
+
+  void _launch(tbb::task_group& group, SystemId id);
+
+  World* world;
+  std::vector<System> systems;
+  std::vector<Node> graph;
+  std::unique_ptr<std::atomic<uint32_t>[]> pending;
+  bool dirty{true};
+};
+
+#pragma region Scheduler_Impl
+
+template <class... Ty>
+SystemAccess SystemAccess::of() {
+  SystemAccess access;
+  (((std::is_const_v<std::remove_reference_t<Ty>> ? access.reads : access.writes).set(World::get_id<Ty>())), ...);
+  return access;
+}
+
+template <class... Ty, class TFn>
+Scheduler::SystemId Scheduler::add_system(std::string name, TFn&& func) {
+  return add_system<Ty...>(std::move(name), SystemAccess{}, std::forward<TFn>(func));
+}
+
+template <class... Ty, class TFn>
+Scheduler::SystemId Scheduler::add_system(std::string name, SystemAccess extra, TFn&& func) {
+  auto query = std::make_shared<Query<Ty...>>(world->query<Ty...>());
+  return _add(std::move(name), SystemAccess::of<Ty...>() | extra, [query, func = std::forward<TFn>(func)]() mutable { func(*query); });
+}
+
+template <class TFn>
+Scheduler::SystemId Scheduler::add_exclusive(std::string name, TFn&& func) {
+  return _add(std::move(name), SystemAccess{.reads = {}, .writes = {}, .exclusive = true}, [world = world, func = std::forward<TFn>(func)]() mutable { func(*world); });
+}
+
+inline Scheduler::SystemId Scheduler::_add(std::string name, SystemAccess access, std::function<void()> body) {
+  systems.push_back({.name = std::move(name), .access = access, .body = std::move(body), .after = {}});
+  dirty = true;
+  return systems.size() - 1;
+}
+
+inline void Scheduler::add_dependency(SystemId system, SystemId dependency) {
+  assert(dependency < system && "dependencies must follow registration order");
+  systems[system].after.emplace_back(dependency);
+  dirty = true;
+}
+
+inline std::vector<Scheduler::SystemId> Scheduler::dependencies(SystemId id) {
+  if (dirty) _build_graph();
+  return graph[id].predecessors;
+}
+
+inline void Scheduler::_build_graph() {
+  graph.assign(systems.size(), Node{});
+  for (SystemId j = 0; j < systems.size(); ++j) {
+    for (SystemId i = 0; i < j; ++i) {
+      bool ordered = systems[i].access.conflicts(systems[j].access);
+      ordered = ordered || std::find(systems[j].after.begin(), systems[j].after.end(), i) != systems[j].after.end();
+      if (!ordered) continue;
+      graph[i].successors.emplace_back(j);
+      graph[j].predecessors.emplace_back(i);
+    }
+  }
+  pending = std::make_unique<std::atomic<uint32_t>[]>(systems.size());
+  dirty = false;
+}
+
+inline void Scheduler::_launch(tbb::task_group& group, SystemId id) {
+  group.run([this, &group, id]() {
+    systems[id].body();
+    for (auto next : graph[id].successors) {
+      if (pending[next].fetch_sub(1, std::memory_order_acq_rel) == 1) _launch(group, next);
+    }
+  });
+}
+
+inline void Scheduler::run() {
+  if (dirty) _build_graph();
+  for (SystemId id = 0; id < systems.size(); ++id) {
+    pending[id].store(uint32_t(graph[id].predecessors.size()), std::memory_order_relaxed);
+  }
+
+  tbb::task_group group;
+  for (SystemId id = 0; id < systems.size(); ++id) {
+    if (graph[id].predecessors.empty()) _launch(group, id);
+  }
+  group.wait();
+}
+
+#pragma endregion
+
+}  // namespace sim::ecs
@@ -1,8 +1,28 @@
 #pragma once
 
 #include <Eigen/Core>
+#include <span>
+#include <type_traits>
 
 namespace sim {
 template <typename T, int D> using Vec = Eigen::Matrix<T, D, 1, 0, D, 1>;
 template <typename T, int N, int M> using Mat = Eigen::Matrix<T, N, M, 0, N, M>;
+
+// View a contiguous run of fixed-size vectors (e.g. a query batch of Vec<Real, 3> or of a
+// component deriving from it) as one Dim x N column-major matrix, without copying.
+template <typename TVec>
+auto as_matrix(std::span<TVec> vecs) {
+  using Real = typename std::remove_const_t<TVec>::Scalar;
+  constexpr int Dim = std::remove_const_t<TVec>::RowsAtCompileTime;
+  static_assert(std::remove_const_t<TVec>::ColsAtCompileTime == 1 && sizeof(TVec) == sizeof(Real) * Dim, "vectors must be tightly packed");
+  using MatN = std::conditional_t<std::is_const_v<TVec>, const Eigen::Matrix<Real, Dim, Eigen::Dynamic>, Eigen::Matrix<Real, Dim, Eigen::Dynamic>>;
+  return Eigen::Map<MatN>(reinterpret_cast<std::conditional_t<std::is_const_v<TVec>, const Real*, Real*>>(vecs.data()), Dim, Eigen::Index(vecs.size()));
+}
+
+// View a contiguous run of scalars as a 1 x N array, e.g. per-particle mass
+template <typename Real>
+auto as_array(std::span<Real> values) {
+  using ArrayN = std::conditional_t<std::is_const_v<Real>, const Eigen::Array<std::remove_const_t<Real>, 1, Eigen::Dynamic>, Eigen::Array<Real, 1, Eigen::Dynamic>>;
+  return Eigen::Map<ArrayN>(values.data(), Eigen::Index(values.size()));
+}
 } // namespace sim
@@ -0,0 +1,138 @@
+#include "math/svd.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+#include "math/svd_kernel.hpp"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SIM_SVD_X86 1
+#else
+#define SIM_SVD_X86 0
+#endif
+
+namespace sim {
+
+namespace detail {
+
+#if SIM_SVD_X86
+// defined in svd_sse.cpp, svd_avx2.cpp and svd_avx512.cpp, each built for its instruction set
+template <class Real, int Dim> void svd_soa_sse(const Real* F, Real* U, Real* sigma, Real* V, size_t count, size_t stride);
+template <class Real, int Dim> void svd_soa_avx2(const Real* F, Real* U, Real* sigma, Real* V, size_t count, size_t stride);
+template <class Real, int Dim> void svd_soa_avx512(const Real* F, Real* U, Real* sigma, Real* V, size_t count, size_t stride);
+#endif
+
+SimdLevel detect_simd_level() {
+#if SIM_SVD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return SimdLevel::avx512;
+  if (__builtin_cpu_supports("avx2")) return SimdLevel::avx2;
+  return SimdLevel::sse;
+#else
+  return SimdLevel::scalar;
+#endif
+}
+
+std::atomic<SimdLevel>& active_simd_level() {
+  static std::atomic<SimdLevel> level{simd_supported()};
+  return level;
+}
+
+template <class Real, int Dim> void svd_soa_dispatch(const Real* F, Real* U, Real* sigma, Real* V, size_t count, size_t stride) {
+  switch (simd_level()) {
+#if SIM_SVD_X86
+    case SimdLevel::avx512:
+      return svd_soa_avx512<Real, Dim>(F, U, sigma, V, count, stride);
+    case SimdLevel::avx2:
+      return svd_soa_avx2<Real, Dim>(F, U, sigma, V, count, stride);
+    case SimdLevel::sse:
+      return svd_soa_sse<Real, Dim>(F, U, sigma, V, count, stride);
+#endif
+    default:
+      return svd_soa<Real, Real, Dim>(F, U, sigma, V, count, stride);
+  }
+}
+
+// AoS matrices are repacked through SoA tiles small enough to stay in L1
+template <class Real, int Dim, class TFn> void for_each_svd_tile(std::span<const Mat<Real, Dim, Dim>> F, TFn&& func) {
+  constexpr size_t tile = 64;
+  alignas(64) Real f[Dim * Dim][tile], u[Dim * Dim][tile], s[Dim][tile], v[Dim * Dim][tile];
+  for (size_t first = 0; first < F.size(); first += tile) {
+    const size_t count = std::min(tile, F.size() - first);
+    for (size_t k = 0; k < count; ++k)
+      for (int i = 0; i < Dim; ++i)
+        for (int j = 0; j < Dim; ++j) f[i * Dim + j][k] = F[first + k](i, j);
+    svd_soa_dispatch<Real, Dim>(&f[0][0], &u[0][0], &s[0][0], &v[0][0], count, tile);
+
+    for (size_t k = 0; k < count; ++k) {
+      Mat<Real, Dim, Dim> U, V;
+      Vec<Real, Dim> sigma;
+      for (int i = 0; i < Dim; ++i) {
+        sigma[i] = s[i][k];
+        for (int j = 0; j < Dim; ++j) {
+          U(i, j) = u[i * Dim + j][k];
+          V(i, j) = v[i * Dim + j][k];
+        }
+      }
+      func(first + k, U, sigma, V);
+    }
+  }
+}
+
+} // namespace detail
+
+SimdLevel simd_supported() {
+  static const SimdLevel supported = detail::detect_simd_level();
+  return supported;
+}
+
+SimdLevel simd_level() { return detail::active_simd_level().load(std::memory_order_relaxed); }
+
+void set_simd_level(SimdLevel level) { detail::active_simd_level().store(std::min(level, simd_supported()), std::memory_order_relaxed); }
+
+const char* simd_level_name(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::sse:
+      return "sse";
+    case SimdLevel::avx2:
+      return "avx2";
+    case SimdLevel::avx512:
+      return "avx512";
+    default:
+      return "scalar";
+  }
+}
+
+template <class Real, int Dim> void batch_svd_soa(const Real* F, Real* U, Real* sigma, Real* V, size_t count) {
+  detail::svd_soa_dispatch<Real, Dim>(F, U, sigma, V, count, count);
+}
+
+template <class Real, int Dim>
+void batch_svd(std::span<const Mat<Real, Dim, Dim>> F, std::span<Mat<Real, Dim, Dim>> U, std::span<Vec<Real, Dim>> sigma, std::span<Mat<Real, Dim, Dim>> V) {
+  detail::for_each_svd_tile<Real, Dim>(F, [&](size_t k, Mat<Real, Dim, Dim> const& u, Vec<Real, Dim> const& s, Mat<Real, Dim, Dim> const& v) {
+    U[k] = u;
+    sigma[k] = s;
+    V[k] = v;
+  });
+}
+
+template <class Real, int Dim> void batch_polar(std::span<const Mat<Real, Dim, Dim>> F, std::span<Mat<Real, Dim, Dim>> R) {
+  detail::for_each_svd_tile<Real, Dim>(F, [&](size_t k, Mat<Real, Dim, Dim> const& u, Vec<Real, Dim> const&, Mat<Real, Dim, Dim> const& v) {
+    R[k] = u * v.transpose();
+  });
+}
+
+#define SIM_SVD_INSTANTIATE(Real, Dim)                                                                                                                         \
+  template void batch_svd_soa<Real, Dim>(const Real*, Real*, Real*, Real*, size_t);                                                                            \
+  template void batch_svd<Real, Dim>(std::span<const Mat<Real, Dim, Dim>>, std::span<Mat<Real, Dim, Dim>>, std::span<Vec<Real, Dim>>,                         \
+                                     std::span<Mat<Real, Dim, Dim>>);                                                                                          \
+  template void batch_polar<Real, Dim>(std::span<const Mat<Real, Dim, Dim>>, std::span<Mat<Real, Dim, Dim>>);
+
+SIM_SVD_INSTANTIATE(float, 2)
+SIM_SVD_INSTANTIATE(float, 3)
+SIM_SVD_INSTANTIATE(double, 2)
+SIM_SVD_INSTANTIATE(double, 3)
+
+#undef SIM_SVD_INSTANTIATE
+
+} // namespace sim
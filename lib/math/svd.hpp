@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+#include "math/numeric_types.hpp"
+
+namespace sim {
+
+// Instruction set used by the batched kernels, picked at runtime from what the CPU supports
+enum class SimdLevel { scalar, sse, avx2, avx512 };
+
+SimdLevel simd_level();
+// the best level this CPU and build support
+SimdLevel simd_supported();
+// force a lower level, e.g. to compare kernels; clamped to simd_supported()
+void set_simd_level(SimdLevel level);
+const char* simd_level_name(SimdLevel level);
+
+// Batched singular value decomposition F = U diag(sigma) V^T of 2x2 and 3x3 matrices in the manner
+// of McAdams et al. 2011: Jacobi eigen-decomposition of F^T F, sorting, and a Givens QR of F V, all
+// without branches so 4, 8 or 16 matrices run in the lanes of one SSE, AVX2 or AVX-512 register.
+// U and V are proper rotations, sigma is sorted by decreasing magnitude and only its last entry can
+// be negative (inverted F), as rotation_svd() in mpm_force.hpp.
+//
+// SoA layout: entry (i, j) of matrix k is at `F[(i * Dim + j) * count + k]`, sigma[i] at `sigma[i * count + k]`.
+template <class Real, int Dim> void batch_svd_soa(const Real* F, Real* U, Real* sigma, Real* V, size_t count);
+
+// same on Eigen matrices, repacked through a small SoA tile
+template <class Real, int Dim>
+void batch_svd(std::span<const Mat<Real, Dim, Dim>> F, std::span<Mat<Real, Dim, Dim>> U, std::span<Vec<Real, Dim>> sigma, std::span<Mat<Real, Dim, Dim>> V);
+
+// rotation R = U V^T of the polar decomposition F = R S
+template <class Real, int Dim> void batch_polar(std::span<const Mat<Real, Dim, Dim>> F, std::span<Mat<Real, Dim, Dim>> R);
+
+} // namespace sim
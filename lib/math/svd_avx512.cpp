@@ -0,0 +1,22 @@
+// compiled with the avx512 instruction set enabled, only called when simd_level() allows it
+#if defined(__GNUC__) && defined(__x86_64__)
+
+#include <type_traits>
+
+#include "math/svd_kernel.hpp"
+
+namespace sim::detail {
+
+template <class Real, int Dim> void svd_soa_avx512(const Real* F, Real* U, Real* sigma, Real* V, size_t count, size_t stride) {
+  using T = std::conditional_t<std::is_same_v<Real, float>, __v16sf, __v8df>;
+  svd_soa<T, Real, Dim>(F, U, sigma, V, count, stride);
+}
+
+template void svd_soa_avx512<float, 2>(const float*, float*, float*, float*, size_t, size_t);
+template void svd_soa_avx512<float, 3>(const float*, float*, float*, float*, size_t, size_t);
+template void svd_soa_avx512<double, 2>(const double*, double*, double*, double*, size_t, size_t);
+template void svd_soa_avx512<double, 3>(const double*, double*, double*, double*, size_t, size_t);
+
+} // namespace sim::detail
+
+#endif
@@ -0,0 +1,176 @@
+#pragma once
+
+// Lane-generic kernel of batch_svd_soa(), only included by the svd*.cpp translation units. Each of
+// them compiles it for its own instruction set, so everything here has internal linkage: copies
+// built with different -m flags must never be merged by the linker.
+//
+// `T` is either the scalar type itself or a GCC vector type (__v4sf, __v4df, ...): arithmetic,
+// comparisons and `mask ? a : b` work the same on both, only sqrt needs an overload per type.
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace sim::detail {
+namespace {
+
+inline float lane_sqrt(float x) { return std::sqrt(x); }
+inline double lane_sqrt(double x) { return std::sqrt(x); }
+#if defined(__SSE2__)
+inline __v4sf lane_sqrt(__v4sf x) { return (__v4sf)_mm_sqrt_ps((__m128)x); }
+inline __v2df lane_sqrt(__v2df x) { return (__v2df)_mm_sqrt_pd((__m128d)x); }
+#endif
+#if defined(__AVX__)
+inline __v8sf lane_sqrt(__v8sf x) { return (__v8sf)_mm256_sqrt_ps((__m256)x); }
+inline __v4df lane_sqrt(__v4df x) { return (__v4df)_mm256_sqrt_pd((__m256d)x); }
+#endif
+#if defined(__AVX512F__)
+// the maskz forms avoid _mm512_undefined_*(), which trips -Wuninitialized on GCC 12
+inline __v16sf lane_sqrt(__v16sf x) { return (__v16sf)_mm512_maskz_sqrt_ps(__mmask16(-1), (__m512)x); }
+inline __v8df lane_sqrt(__v8df x) { return (__v8df)_mm512_maskz_sqrt_pd(__mmask8(-1), (__m512d)x); }
+#endif
+
+template <class T, class Real> T splat(Real x) { return T{} + x; }
+
+template <class T> T lane_load(const void* src) {
+  T value;
+  std::memcpy(&value, src, sizeof(T));
+  return value;
+}
+
+template <class T> void lane_store(void* dst, T value) { std::memcpy(dst, &value, sizeof(T)); }
+
+// exact Jacobi rotation zeroing s[p][q] of the symmetric `s`, accumulated into `v`
+template <class T, class Real, int Dim> inline void jacobi_rotate(T (&s)[Dim][Dim], T (&v)[Dim][Dim], int p, int q) {
+  const T zero = splat<T>(Real(0)), one = splat<T>(Real(1));
+  const T spq = s[p][q];
+  const auto rotate = spq != zero;
+  const T theta = (s[q][q] - s[p][p]) / (Real(2) * (rotate ? spq : one));
+  const T abs_theta = theta < zero ? -theta : theta;
+  T t = one / (abs_theta + lane_sqrt(one + theta * theta));
+  t = theta < zero ? -t : t;
+  t = rotate ? t : zero;
+  const T c = one / lane_sqrt(one + t * t);
+  const T sn = t * c;
+
+  s[p][p] = s[p][p] - t * spq;
+  s[q][q] = s[q][q] + t * spq;
+  s[p][q] = s[q][p] = zero;
+  for (int r = 0; r < Dim; ++r) {
+    if (r != p && r != q) {
+      const T srp = s[r][p], srq = s[r][q];
+      s[r][p] = s[p][r] = c * srp - sn * srq;
+      s[r][q] = s[q][r] = sn * srp + c * srq;
+    }
+    const T vrp = v[r][p], vrq = v[r][q];
+    v[r][p] = c * vrp - sn * vrq;
+    v[r][q] = sn * vrp + c * vrq;
+  }
+}
+
+// Givens rotation of rows (j, i) zeroing b[i][j], B = U R is kept by rotating the columns of `u`
+template <class T, class Real, int Dim> inline void givens_qr(T (&b)[Dim][Dim], T (&u)[Dim][Dim], int j, int i) {
+  const T zero = splat<T>(Real(0)), one = splat<T>(Real(1));
+  const T x = b[j][j], y = b[i][j];
+  const T rho2 = x * x + y * y;
+  const auto valid = rho2 > zero;
+  const T inv_rho = one / lane_sqrt(valid ? rho2 : one);
+  const T c = valid ? x * inv_rho : one;
+  const T sn = valid ? y * inv_rho : zero;
+  for (int col = 0; col < Dim; ++col) {
+    const T bj = b[j][col], bi = b[i][col];
+    b[j][col] = c * bj + sn * bi;
+    b[i][col] = c * bi - sn * bj;
+  }
+  for (int r = 0; r < Dim; ++r) {
+    const T uj = u[r][j], ui = u[r][i];
+    u[r][j] = c * uj + sn * ui;
+    u[r][i] = c * ui - sn * uj;
+  }
+}
+
+// swap columns p and q of `b` and `v` where `norm2[p] < norm2[q]`, negating one keeps det(V) = 1
+template <class T, int Dim> inline void sort_columns(T (&b)[Dim][Dim], T (&v)[Dim][Dim], T (&norm2)[Dim], int p, int q) {
+  const auto swap = norm2[p] < norm2[q];
+  for (int r = 0; r < Dim; ++r) {
+    const T bp = b[r][p], bq = b[r][q];
+    b[r][p] = swap ? bq : bp;
+    b[r][q] = swap ? -bp : bq;
+    const T vp = v[r][p], vq = v[r][q];
+    v[r][p] = swap ? vq : vp;
+    v[r][q] = swap ? -vp : vq;
+  }
+  const T np = norm2[p], nq = norm2[q];
+  norm2[p] = swap ? nq : np;
+  norm2[q] = swap ? np : nq;
+}
+
+// the sizeof(T) / sizeof(Real) matrices starting at lane 0 of every SoA entry
+template <class T, class Real, int Dim> inline void svd_lanes(const Real* F, Real* U, Real* sigma, Real* V, size_t stride) {
+  // a 2x2 Jacobi rotation is exact, 3x3 cyclic sweeps converge quadratically
+  constexpr int sweeps = Dim == 2 ? 1 : 5;
+  const T zero = splat<T>(Real(0)), one = splat<T>(Real(1));
+
+  T a[Dim][Dim], s[Dim][Dim], v[Dim][Dim];
+  for (int i = 0; i < Dim; ++i)
+    for (int j = 0; j < Dim; ++j) {
+      a[i][j] = lane_load<T>(F + (i * Dim + j) * stride);
+      v[i][j] = i == j ? one : zero;
+    }
+
+  // eigenvectors of the symmetric F^T F are the right singular vectors
+  for (int i = 0; i < Dim; ++i)
+    for (int j = i; j < Dim; ++j) {
+      T dot = zero;
+      for (int k = 0; k < Dim; ++k) dot += a[k][i] * a[k][j];
+      s[i][j] = s[j][i] = dot;
+    }
+  for (int sweep = 0; sweep < sweeps; ++sweep)
+    for (int p = 0; p < Dim; ++p)
+      for (int q = p + 1; q < Dim; ++q) jacobi_rotate<T, Real, Dim>(s, v, p, q);
+
+  // B = F V has orthogonal columns, sorted by decreasing norm
+  T b[Dim][Dim], norm2[Dim];
+  for (int i = 0; i < Dim; ++i)
+    for (int j = 0; j < Dim; ++j) {
+      T dot = zero;
+      for (int k = 0; k < Dim; ++k) dot += a[i][k] * v[k][j];
+      b[i][j] = dot;
+    }
+  for (int j = 0; j < Dim; ++j) {
+    norm2[j] = zero;
+    for (int i = 0; i < Dim; ++i) norm2[j] += b[i][j] * b[i][j];
+  }
+  for (int p = 0; p < Dim; ++p)
+    for (int q = p + 1; q < Dim; ++q) sort_columns<T, Dim>(b, v, norm2, p, q);
+
+  // B = U R with R diagonal up to round-off: sigma = diag(R), all but the last entry non-negative
+  T u[Dim][Dim];
+  for (int i = 0; i < Dim; ++i)
+    for (int j = 0; j < Dim; ++j) u[i][j] = i == j ? one : zero;
+  for (int j = 0; j < Dim; ++j)
+    for (int i = j + 1; i < Dim; ++i) givens_qr<T, Real, Dim>(b, u, j, i);
+
+  for (int i = 0; i < Dim; ++i) {
+    lane_store(sigma + i * stride, b[i][i]);
+    for (int j = 0; j < Dim; ++j) {
+      lane_store(U + (i * Dim + j) * stride, u[i][j]);
+      lane_store(V + (i * Dim + j) * stride, v[i][j]);
+    }
+  }
+}
+
+// `count` matrices with SoA stride `stride`, full register groups first and the tail lane by lane
+template <class T, class Real, int Dim> void svd_soa(const Real* F, Real* U, Real* sigma, Real* V, size_t count, size_t stride) {
+  constexpr size_t width = sizeof(T) / sizeof(Real);
+  size_t k = 0;
+  for (; k + width <= count; k += width) svd_lanes<T, Real, Dim>(F + k, U + k, sigma + k, V + k, stride);
+  for (; k < count; ++k) svd_lanes<Real, Real, Dim>(F + k, U + k, sigma + k, V + k, stride);
+}
+
+} // namespace
+} // namespace sim::detail
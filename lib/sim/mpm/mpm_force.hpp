@@ -1,5 +1,313 @@
 #pragma once
 
+#include <Eigen/LU>
+#include <Eigen/SVD>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numbers>
+#include <span>
+#include <tuple>
+#include <type_traits>
+
+#include "math/numeric_types.hpp"
+#include "math/svd.hpp"
+
 namespace sim::mpm {
-struct MPMForce {};
+
+// Lame parameters from Young's modulus and Poisson's ratio
+template <class Real> Real lame_mu(Real youngs_modulus, Real poisson_ratio) { return youngs_modulus / (2 * (1 + poisson_ratio)); }
+
+template <class Real> Real lame_lambda(Real youngs_modulus, Real poisson_ratio) {
+  return youngs_modulus * poisson_ratio / ((1 + poisson_ratio) * (1 - 2 * poisson_ratio));
+}
+
+// F = U diag(sigma) V^T with U and V proper rotations, a reflection is moved into the smallest singular value
+template <class Real, int Dim> void rotation_svd(Mat<Real, Dim, Dim> const& F, Mat<Real, Dim, Dim>& U, Vec<Real, Dim>& sigma, Mat<Real, Dim, Dim>& V) {
+  Eigen::JacobiSVD<Mat<Real, Dim, Dim>> svd(F, Eigen::ComputeFullU | Eigen::ComputeFullV);
+  U = svd.matrixU();
+  V = svd.matrixV();
+  sigma = svd.singularValues();
+  if (U.determinant() < 0) {
+    U.col(Dim - 1) *= -1;
+    sigma[Dim - 1] *= -1;
+  }
+  if (V.determinant() < 0) {
+    V.col(Dim - 1) *= -1;
+    sigma[Dim - 1] *= -1;
+  }
+}
+
+// Kirchhoff stress tau = P F^T of the fixed corotated model (Stomakhin et al. 2012) given the
+// rotated SVD of F, R = U V^T is the rotation of the polar decomposition F = R S
+template <class Real, int Dim>
+Mat<Real, Dim, Dim> fixed_corotated_stress(Mat<Real, Dim, Dim> const& F, Mat<Real, Dim, Dim> const& U, Vec<Real, Dim> const& sigma, Mat<Real, Dim, Dim> const& V,
+                                           Real mu, Real lambda) {
+  const Mat<Real, Dim, Dim> R = U * V.transpose();
+  const Real J = sigma.prod();
+  return 2 * mu * (F - R) * F.transpose() + Mat<Real, Dim, Dim>::Identity() * (lambda * (J - 1) * J);
+}
+
+template <class Real, int Dim> Mat<Real, Dim, Dim> fixed_corotated_stress(Mat<Real, Dim, Dim> const& F, Real mu, Real lambda) {
+  Mat<Real, Dim, Dim> U, V;
+  Vec<Real, Dim> sigma;
+  rotation_svd<Real, Dim>(F, U, sigma, V);
+  return fixed_corotated_stress<Real, Dim>(F, U, sigma, V, mu, lambda);
+}
+
+// Kirchhoff stress of the Hencky (StVK in log strain) model, from the rotated SVD of F.
+// Singular values are floored so inverted or fully collapsed particles keep a finite strain.
+template <class Real, int Dim> Mat<Real, Dim, Dim> hencky_stress(Mat<Real, Dim, Dim> const& U, Vec<Real, Dim> const& sigma, Real mu, Real lambda) {
+  const Vec<Real, Dim> eps = sigma.cwiseMax(Real(1e-4)).array().log();
+  const Vec<Real, Dim> principal = 2 * mu * eps + Vec<Real, Dim>::Constant(lambda * eps.sum());
+  return U * principal.asDiagonal() * U.transpose();
+}
+
+namespace detail {
+
+// `func(U, sigma, V)` with the rotated SVD of a single F
+template <class Real, int Dim, class TFn> decltype(auto) with_svd(Mat<Real, Dim, Dim> const& F, TFn&& func) {
+  Mat<Real, Dim, Dim> U, V;
+  Vec<Real, Dim> sigma;
+  rotation_svd<Real, Dim>(F, U, sigma, V);
+  return func(U, sigma, V);
+}
+
+// `func(i, U, sigma, V)` for every F of a batch, decomposed a tile at a time by batch_svd()
+template <class TM, class TF, class TFn> void for_each_svd(std::span<TF> Fs, TFn&& func) {
+  using Real = typename TM::Scalar;
+  constexpr int Dim = TM::RowsAtCompileTime;
+  static_assert(sizeof(TF) == sizeof(TM) && std::is_base_of_v<TM, std::remove_const_t<TF>>, "F must be laid out as the Eigen matrix");
+  constexpr size_t tile = 64;
+  std::array<TM, tile> U, V;
+  std::array<Vec<Real, Dim>, tile> sigma;
+  for (size_t first = 0; first < Fs.size(); first += tile) {
+    const size_t count = std::min(tile, Fs.size() - first);
+    batch_svd<Real, Dim>(std::span<const TM>(static_cast<const TM*>(&Fs[first]), count), std::span(U).first(count), std::span(sigma).first(count),
+                         std::span(V).first(count));
+    for (size_t k = 0; k < count; ++k) func(first + k, U[k], sigma[k], V[k]);
+  }
+}
+
+} // namespace detail
+
+// Constitutive models. Every model is a compile-time policy with
+//   State                              per-particle plastic state, also the component that puts a
+//                                      particle into the archetype of its material
+//   plastic                            whether project() ever changes F
+//   uses_svd                           whether the overloads below taking the rotated SVD
+//                                      F = U diag(sigma) V^T exist, batches then decompose with batch_svd()
+//   kirchhoff(F, [U, sigma, V,] state) Kirchhoff stress of the elastic deformation gradient
+//   project(F, [U, sigma, V,] state)   return mapping of F onto the yield surface, after G2P
+//   wave_modulus(state)                P-wave modulus lambda + 2 mu at the plastic state, bounds the
+//                                      elastic wave speed sqrt(modulus / density) for the CFL step
+// kirchhoff_batch() and project_batch() run them over the SoA spans of one archetype chunk, so each
+// material gets its own inlined kernel and particles never dispatch on their material.
+
+// Fixed corotated elasticity (Stomakhin et al. 2012)
+template <class Real, int Dim> struct FixedCorotated {
+  using TM = Mat<Real, Dim, Dim>;
+  using TV = Vec<Real, Dim>;
+  struct State {};
+  static constexpr bool plastic = false;
+  static constexpr bool uses_svd = true;
+
+  Real mu;
+  Real lambda;
+
+  FixedCorotated(Real youngs_modulus, Real poisson_ratio) : mu(lame_mu(youngs_modulus, poisson_ratio)), lambda(lame_lambda(youngs_modulus, poisson_ratio)) {}
+
+  Real wave_modulus(State const&) const { return lambda + 2 * mu; }
+
+  TM kirchhoff(TM const& F, TM const& U, TV const& sigma, TM const& V, State const&) const {
+    return fixed_corotated_stress<Real, Dim>(F, U, sigma, V, mu, lambda);
+  }
+  TM kirchhoff(TM const& F, State const&) const { return fixed_corotated_stress<Real, Dim>(F, mu, lambda); }
+  void project(TM&, TM const&, TV const&, TM const&, State&) const {}
+  void project(TM&, State&) const {}
+};
+
+// compressible Neo-Hookean elasticity, not inversion safe
+template <class Real, int Dim> struct NeoHookean {
+  using TM = Mat<Real, Dim, Dim>;
+  struct State {};
+  static constexpr bool plastic = false;
+  static constexpr bool uses_svd = false;
+
+  Real mu;
+  Real lambda;
+
+  NeoHookean(Real youngs_modulus, Real poisson_ratio) : mu(lame_mu(youngs_modulus, poisson_ratio)), lambda(lame_lambda(youngs_modulus, poisson_ratio)) {}
+
+  Real wave_modulus(State const&) const { return lambda + 2 * mu; }
+
+  TM kirchhoff(TM const& F, State const&) const { return mu * (F * F.transpose() - TM::Identity()) + TM::Identity() * (lambda * std::log(F.determinant())); }
+  void project(TM&, State&) const {}
+};
+
+// snow plasticity (Stomakhin et al. 2013): fixed corotated elasticity hardened by the plastic
+// compression, singular values of the elastic F are clamped to [1 - critical_compression, 1 + critical_stretch]
+template <class Real, int Dim> struct Snow {
+  using TM = Mat<Real, Dim, Dim>;
+  using TV = Vec<Real, Dim>;
+  struct State {
+    Real Jp = 1; // plastic volume ratio
+  };
+  static constexpr bool plastic = true;
+  static constexpr bool uses_svd = true;
+
+  Real mu;
+  Real lambda;
+  Real hardening = 10;
+  Real critical_compression = Real(2.5e-2);
+  Real critical_stretch = Real(7.5e-3);
+
+  Snow(Real youngs_modulus, Real poisson_ratio) : mu(lame_mu(youngs_modulus, poisson_ratio)), lambda(lame_lambda(youngs_modulus, poisson_ratio)) {}
+
+  // the hardened moduli stiffen compressed snow, and its waves travel faster
+  Real wave_modulus(State const& state) const { return (lambda + 2 * mu) * std::exp(hardening * (1 - state.Jp)); }
+
+  TM kirchhoff(TM const& F, TM const& U, TV const& sigma, TM const& V, State const& state) const {
+    const Real h = std::exp(hardening * (1 - state.Jp));
+    return fixed_corotated_stress<Real, Dim>(F, U, sigma, V, mu * h, lambda * h);
+  }
+
+  void project(TM& F, TM const& U, TV sigma, TM const& V, State& state) const {
+    const Real J = sigma.prod();
+    sigma = sigma.cwiseMax(1 - critical_compression).cwiseMin(1 + critical_stretch);
+    state.Jp *= J / sigma.prod();
+    F = U * sigma.asDiagonal() * V.transpose();
+  }
+
+  TM kirchhoff(TM const& F, State const& state) const { return detail::with_svd(F, [&](auto const&... svd) { return kirchhoff(F, svd..., state); }); }
+  void project(TM& F, State& state) const { detail::with_svd(F, [&](auto const&... svd) { project(F, svd..., state); }); }
+};
+
+// Drucker-Prager sand (Klar et al. 2016): Hencky elasticity, the friction angle hardens with the
+// accumulated plastic strain q as phi = h0 + (h1 q - h3) exp(-h2 q), angles in degrees
+template <class Real, int Dim> struct DruckerPrager {
+  using TM = Mat<Real, Dim, Dim>;
+  using TV = Vec<Real, Dim>;
+  struct State {
+    Real q = 0;
+  };
+  static constexpr bool plastic = true;
+  static constexpr bool uses_svd = true;
+
+  Real mu;
+  Real lambda;
+  Real h0 = 35;
+  Real h1 = 9;
+  Real h2 = Real(0.2);
+  Real h3 = 10;
+
+  DruckerPrager(Real youngs_modulus, Real poisson_ratio) : mu(lame_mu(youngs_modulus, poisson_ratio)), lambda(lame_lambda(youngs_modulus, poisson_ratio)) {}
+
+  Real wave_modulus(State const&) const { return lambda + 2 * mu; }
+
+  TM kirchhoff(TM const&, TM const& U, TV const& sigma, TM const&, State const&) const { return hencky_stress<Real, Dim>(U, sigma, mu, lambda); }
+
+  Real friction(Real q) const {
+    const Real phi = (h0 + (h1 * q - h3) * std::exp(-h2 * q)) * std::numbers::pi_v<Real> / 180;
+    const Real s = std::sin(phi);
+    return std::sqrt(Real(2) / 3) * 2 * s / (3 - s);
+  }
+
+  void project(TM& F, TM const& U, TV const& sigma, TM const& V, State& state) const {
+    TV eps = sigma.cwiseMax(Real(1e-4)).array().log();
+    const Real trace = eps.sum();
+    const TV deviator = eps - TV::Constant(trace / Dim);
+    const Real deviator_norm = deviator.norm();
+
+    if (trace >= 0) {
+      // expansion: the material separates and loses all elastic strain
+      state.q += eps.norm();
+      eps.setZero();
+    } else {
+      const Real dgamma = deviator_norm + (Dim * lambda + 2 * mu) / (2 * mu) * trace * friction(state.q);
+      if (dgamma <= 0) return; // inside the yield cone
+      eps -= dgamma / deviator_norm * deviator;
+      state.q += dgamma;
+    }
+    F = U * TV(eps.array().exp()).asDiagonal() * V.transpose();
+  }
+
+  TM kirchhoff(TM const& F, State const& state) const { return detail::with_svd(F, [&](auto const&... svd) { return kirchhoff(F, svd..., state); }); }
+  void project(TM& F, State& state) const { detail::with_svd(F, [&](auto const&... svd) { project(F, svd..., state); }); }
+};
+
+// von Mises plasticity with Hencky elasticity, the deviatoric Kirchhoff stress is capped at yield_stress
+template <class Real, int Dim> struct VonMises {
+  using TM = Mat<Real, Dim, Dim>;
+  using TV = Vec<Real, Dim>;
+  struct State {
+    Real plastic_strain = 0;
+  };
+  static constexpr bool plastic = true;
+  static constexpr bool uses_svd = true;
+
+  Real mu;
+  Real lambda;
+  Real yield_stress;
+
+  VonMises(Real youngs_modulus, Real poisson_ratio)
+      : mu(lame_mu(youngs_modulus, poisson_ratio)), lambda(lame_lambda(youngs_modulus, poisson_ratio)), yield_stress(youngs_modulus * Real(1e-2)) {}
+
+  Real wave_modulus(State const&) const { return lambda + 2 * mu; }
+
+  TM kirchhoff(TM const&, TM const& U, TV const& sigma, TM const&, State const&) const { return hencky_stress<Real, Dim>(U, sigma, mu, lambda); }
+
+  void project(TM& F, TM const& U, TV const& sigma, TM const& V, State& state) const {
+    TV eps = sigma.cwiseMax(Real(1e-4)).array().log();
+    const TV deviator = eps - TV::Constant(eps.sum() / Dim);
+    const Real deviator_norm = deviator.norm();
+    const Real dgamma = deviator_norm - yield_stress / (2 * mu);
+    if (dgamma <= 0) return;
+    eps -= dgamma / deviator_norm * deviator;
+    state.plastic_strain += dgamma;
+    F = U * TV(eps.array().exp()).asDiagonal() * V.transpose();
+  }
+
+  TM kirchhoff(TM const& F, State const& state) const { return detail::with_svd(F, [&](auto const&... svd) { return kirchhoff(F, svd..., state); }); }
+  void project(TM& F, State& state) const { detail::with_svd(F, [&](auto const&... svd) { project(F, svd..., state); }); }
+};
+
+// every model the solver knows, one particle archetype each
+template <class Real, int Dim> using Materials = std::tuple<FixedCorotated<Real, Dim>, NeoHookean<Real, Dim>, Snow<Real, Dim>, DruckerPrager<Real, Dim>, VonMises<Real, Dim>>;
+
+template <class TMaterials, class Real> TMaterials make_materials(Real youngs_modulus, Real poisson_ratio) {
+  return [&]<class... TMaterial>(std::type_identity<std::tuple<TMaterial...>>) {
+    return TMaterials(TMaterial(youngs_modulus, poisson_ratio)...);
+  }(std::type_identity<TMaterials>{});
+}
+
+// `taus[i]` = Kirchhoff stress of `Fs[i]`, over one batch of a single material
+template <class TMaterial, class TF>
+void kirchhoff_batch(TMaterial const& material, std::span<const TF> Fs, std::span<const typename TMaterial::State> states, std::span<typename TMaterial::TM> taus) {
+  if constexpr (TMaterial::uses_svd) {
+    detail::for_each_svd<typename TMaterial::TM>(Fs, [&](size_t i, auto const& U, auto const& sigma, auto const& V) {
+      taus[i] = material.kirchhoff(Fs[i], U, sigma, V, states[i]);
+    });
+  } else {
+    for (size_t i = 0; i < Fs.size(); ++i) taus[i] = material.kirchhoff(Fs[i], states[i]);
+  }
+}
+
+// largest wave_modulus() over one batch of a single material, 0 for an empty batch
+template <class TMaterial> auto max_wave_modulus(TMaterial const& material, std::span<const typename TMaterial::State> states) {
+  decltype(material.mu) result = 0;
+  for (auto const& state : states) result = std::max(result, material.wave_modulus(state));
+  return result;
+}
+
+// return mapping of one batch of a single material, F and the plastic state are updated in place
+template <class TMaterial, class TF> void project_batch(TMaterial const& material, std::span<TF> Fs, std::span<typename TMaterial::State> states) {
+  if constexpr (TMaterial::plastic && TMaterial::uses_svd) {
+    detail::for_each_svd<typename TMaterial::TM>(Fs, [&](size_t i, auto const& U, auto const& sigma, auto const& V) { material.project(Fs[i], U, sigma, V, states[i]); });
+  } else if constexpr (TMaterial::plastic) {
+    for (size_t i = 0; i < Fs.size(); ++i) material.project(Fs[i], states[i]);
+  }
+}
+
 } // namespace sim::mpm
@@ -1,3 +1,477 @@
 #pragma once
 
-namespace sim::mpm {}
\ No newline at end of file
+#include <SPGrid/Core/SPGrid_Allocator.h>
+#include <SPGrid/Core/SPGrid_Page_Map.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "math/numeric_types.hpp"
+
+namespace sim::mpm {
+
+template <class Real, int Dim> struct GridNode {
+  Vec<Real, Dim> velocity; // momentum during P2G, velocity after the grid update
+  Real mass;
+};
+
+// compile-time neighborhoods for MpmGrid::apply_stencil, offsets of every node from the center
+
+// the center and its 2 * Dim axis neighbors: the 5-point (2D) and 7-point (3D) stencil. The center
+// comes first, then the lower and upper neighbor along each axis
+template <int Dim> struct StarStencil {
+  static constexpr int size = 2 * Dim + 1;
+  static constexpr std::array<std::array<int, Dim>, size> offsets = [] {
+    std::array<std::array<int, Dim>, size> result{};
+    for (int d = 0; d < Dim; ++d) {
+      result[1 + 2 * d][d] = -1;
+      result[2 + 2 * d][d] = 1;
+    }
+    return result;
+  }();
+};
+
+// the 3x3 (2D) and 3x3x3 (3D) neighborhood, offset `s` is (s % 3 - 1, s / 3 % 3 - 1, s / 9 - 1)
+template <int Dim> struct BoxStencil {
+  static constexpr int size = Dim == 3 ? 27 : 9;
+  static constexpr std::array<std::array<int, Dim>, size> offsets = [] {
+    std::array<std::array<int, Dim>, size> result{};
+    for (int s = 0; s < size; ++s) {
+      for (int d = 0, rest = s; d < Dim; ++d, rest /= 3) result[s][d] = rest % 3 - 1;
+    }
+    return result;
+  }();
+};
+
+namespace detail {
+// z bits of a block, 2D masks have no z axis
+template <class Mask, int Dim> constexpr int block_zbits() {
+  if constexpr (Dim == 3) {
+    return Mask::block_zbits;
+  } else {
+    return 0;
+  }
+}
+} // namespace detail
+
+// Background grid of the MPM solver on the SPGrid allocator. Nodes are addressed by their SPGrid
+// linear offset: nodes of one 4KB block are contiguous in memory and blocks are only backed by
+// physical pages once written. The page map records the blocks touched during P2G, and every grid
+// operator, clearing included, runs over that block list only: the cost of a step scales with the
+// active blocks, not with the padded volume. Blocks outside the list are always zero.
+// Cleared blocks are recycled: they stay resident, so touching them again costs no page fault, until
+// the resident blocks exceed a high-water mark and the ones outside the list go back to the OS.
+template <class Real, int Dim> class MpmGrid {
+public:
+  using Node = GridNode<Real, Dim>;
+  using Allocator = SPGrid::SPGrid_Allocator<Node, Dim>;
+  using Mask = typename Allocator::template Array_mask<>;
+  using Array = typename Allocator::template Array_type<>;
+  using PageMap = SPGrid::SPGrid_Page_Map<>;
+  using Coord = Vec<int, Dim>;
+
+  static constexpr int stencil_size = Dim == 3 ? 27 : 9;
+  static constexpr uint32_t elements_per_block = Mask::elements_per_block;
+  static constexpr uint64_t element_bytes = uint64_t(1) << Allocator::log2_struct;
+  static constexpr uint64_t block_bytes = uint64_t(elements_per_block) * element_bytes;
+  // a stencil reaches at most into the next block along each axis, so blocks of the same
+  // coordinate parity never share a node and 2^Dim colors separate them
+  static constexpr int colors = 1 << Dim;
+  static_assert(Mask::block_xbits >= 1 && Mask::block_ybits >= 1 && (Dim < 3 || detail::block_zbits<Mask, Dim>() >= 1),
+                "blocks must span at least two nodes per axis");
+
+  // `resolution` cells along every axis, nodes [0, resolution] are addressable. `policy` picks
+  // the page size backing the nodes, see SPGrid::Page_Policy. At most `resident_limit` bytes of
+  // cleared blocks are kept resident for reuse, 0 returns them to the OS at every clear()
+  explicit MpmGrid(int resolution, SPGrid::Page_Policy policy = SPGrid::Page_Policy::Default,
+                   uint64_t resident_limit = std::numeric_limits<uint64_t>::max());
+
+  int resolution() const { return grid_resolution; }
+
+  // the page policy obtained, a huge page policy may have fallen back to a smaller one
+  SPGrid::Page_Policy page_policy() const { return allocator.Get_Page_Policy(); }
+
+  static uint64_t offset(Coord const& node);
+
+  // offsets of the 3^Dim quadratic B-spline stencil relative to its lowest node, the flattened
+  // index `s` holds the node (s % 3, s / 3 % 3, s / 9)
+  static std::array<uint64_t, stencil_size> const& stencil();
+
+  static uint64_t neighbor(uint64_t base, uint64_t stencil_offset) { return Mask::Packed_Add(base, stencil_offset); }
+
+  // offset of the block holding `offset`
+  static uint64_t block_of(uint64_t offset) { return offset & ~(block_bytes - 1); }
+
+  // nodes per block along every axis
+  static Coord block_size();
+
+  // the block after `block` along every axis set in `axes` (bit d for axis d)
+  static uint64_t next_block(uint64_t block, int axes);
+
+  // parity of the block coordinates, bit d for axis d
+  static int block_color(uint64_t block);
+
+  Node& operator()(uint64_t offset) { return data(offset); }
+
+  // mark the block holding `offset` as active for this step
+  void activate(uint64_t offset) { page_map.Set_Page(offset); }
+
+  // same, safe to call from many threads at once; the blocks join blocks() at commit_blocks()
+  void activate_concurrent(uint64_t offset) { page_map.Set_Page_Concurrent(offset); }
+
+  // publish the blocks of activate_concurrent(), not thread-safe
+  void commit_blocks() { page_map.Update_Block_Offsets(); }
+
+  std::span<const uint64_t> blocks() const;
+
+  // `func(Coord const& node, Node& data)` on every node of the active blocks, blocks run in parallel
+  template <class TFn> void for_each_node(TFn&& func);
+
+  // `out(Node& data, Real value)` with value the sum of weights[s] * in(node + TStencil::offsets[s])
+  // on every node of the active blocks, for a scalar field `in(Node const&) -> Real`. Nodes outside
+  // the active blocks read as zero. Each block is gathered into a dense tile with a one-node halo:
+  // only the halo at the block faces needs packed-offset lookups into the neighbor blocks, and the
+  // weighted sum runs over whole rows of the tile, which the compiler vectorizes. All values are
+  // computed before the first `out`, so it may overwrite the field `in` reads.
+  template <class TStencil, class TIn, class TOut> void apply_stencil(std::array<Real, TStencil::size> const& weights, TIn&& in, TOut&& out);
+
+  // whether the block holding `offset` is active
+  bool is_active(uint64_t offset) const { return page_map.Test_Page(offset); }
+
+  // zero the active blocks and forget the block list, their pages stay resident for the next step.
+  // Past the resident limit, release() runs first
+  void clear();
+
+  // return the resident blocks outside the active list to the OS. Under Transparent_Huge only whole
+  // 2MB pages free of active blocks are released, a 4KB madvise would split the huge page; the
+  // other resident blocks are kept. Under Explicit_Huge nothing is released, the mapping keeps its
+  // hugetlbfs pages reserved either way
+  void release();
+
+  // blocks written since they were last released, the active ones included
+  size_t resident_blocks() const { return resident.Get_Blocks().second; }
+
+private:
+  static Coord _block_origin(uint64_t block);
+  static Coord _element_coord(uint32_t element);
+
+  // apply_stencil() tiles: a block plus a halo of one node on both sides, the last axis contiguous
+  // like within the block
+  static constexpr std::array<int, Dim> _tile_extent = [] {
+    if constexpr (Dim == 3) {
+      return std::array<int, Dim>{(1 << Mask::block_xbits) + 2, (1 << Mask::block_ybits) + 2, (1 << Mask::block_zbits) + 2};
+    } else {
+      return std::array<int, Dim>{(1 << Mask::block_xbits) + 2, (1 << Mask::block_ybits) + 2};
+    }
+  }();
+  static constexpr std::array<int, Dim> _tile_stride = [] {
+    std::array<int, Dim> result{};
+    result[Dim - 1] = 1;
+    for (int d = Dim - 2; d >= 0; --d) result[d] = result[d + 1] * _tile_extent[d + 1];
+    return result;
+  }();
+  static constexpr int _tile_size = _tile_stride[0] * _tile_extent[0];
+  // nodes of a block row, along the last axis
+  static constexpr int _row_size = _tile_extent[Dim - 1] - 2;
+
+  // tile index of the node at block coordinates `local`, -1 and the block size along an axis are halo
+  static int _tile_index(Coord const& local) {
+    int index = 0;
+    for (int d = 0; d < Dim; ++d) index += (local[d] + 1) * _tile_stride[d];
+    return index;
+  }
+
+  // a halo node: its tile index, its offset from the block origin and the neighbor block holding
+  // it, numbered like BoxStencil with the block itself at the center
+  struct HaloNode {
+    int index;
+    uint64_t offset;
+    int neighbor;
+  };
+  // the halo nodes outside the block along at most `reach` axes, 1 covers the faces only
+  template <int reach> static std::vector<HaloNode> const& _halo();
+  static void _zero_block(std::byte* block);
+
+  int grid_resolution;
+  uint64_t resident_limit;
+  Allocator allocator;
+  PageMap page_map;
+  PageMap resident; // block list of the resident blocks, in activation order
+  Array data;
+};
+
+#pragma region MpmGrid_Definitions
+
+namespace detail {
+
+template <int Dim> std::array<SPGrid::ucoord_t, Dim> grid_size(int resolution) {
+  std::array<SPGrid::ucoord_t, Dim> size;
+  size.fill(SPGrid::ucoord_t(resolution + 3));
+  return size;
+}
+
+} // namespace detail
+
+template <class Real, int Dim>
+MpmGrid<Real, Dim>::MpmGrid(int resolution, SPGrid::Page_Policy policy, uint64_t resident_limit)
+    : grid_resolution(resolution),
+      resident_limit(resident_limit),
+      allocator(detail::grid_size<Dim>(resolution), policy),
+      page_map(allocator),
+      resident(allocator),
+      data(allocator.Get_Array()) {}
+
+template <class Real, int Dim> uint64_t MpmGrid<Real, Dim>::offset(Coord const& node) {
+  if constexpr (Dim == 3) {
+    return Mask::Linear_Offset(node[0], node[1], node[2]);
+  } else {
+    return Mask::Linear_Offset(node[0], node[1]);
+  }
+}
+
+template <class Real, int Dim> auto MpmGrid<Real, Dim>::stencil() -> std::array<uint64_t, stencil_size> const& {
+  static const auto offsets = [] {
+    std::array<uint64_t, stencil_size> result;
+    for (int s = 0; s < stencil_size; ++s) {
+      Coord node;
+      for (int d = 0, rest = s; d < Dim; ++d, rest /= 3) node[d] = rest % 3;
+      result[s] = offset(node);
+    }
+    return result;
+  }();
+  return offsets;
+}
+
+template <class Real, int Dim> auto MpmGrid<Real, Dim>::block_size() -> Coord {
+  if constexpr (Dim == 3) {
+    return Coord(1 << Mask::block_xbits, 1 << Mask::block_ybits, 1 << Mask::block_zbits);
+  } else {
+    return Coord(1 << Mask::block_xbits, 1 << Mask::block_ybits);
+  }
+}
+
+template <class Real, int Dim> uint64_t MpmGrid<Real, Dim>::next_block(uint64_t block, int axes) {
+  static const auto steps = [] {
+    std::array<uint64_t, colors> result;
+    for (int axes = 0; axes < colors; ++axes) {
+      Coord step = Coord::Zero();
+      for (int d = 0; d < Dim; ++d) step[d] = (axes >> d & 1) ? block_size()[d] : 0;
+      result[axes] = offset(step);
+    }
+    return result;
+  }();
+  return Mask::Packed_Add(block, steps[axes]);
+}
+
+template <class Real, int Dim> int MpmGrid<Real, Dim>::block_color(uint64_t block) {
+  // one block along axis d is a single address bit, the lowest page bit of that axis
+  int color = 0;
+  for (int d = 0; d < Dim; ++d) {
+    color |= (block & next_block(0, 1 << d)) ? 1 << d : 0;
+  }
+  return color;
+}
+
+template <class Real, int Dim> std::span<const uint64_t> MpmGrid<Real, Dim>::blocks() const {
+  auto [ptr, count] = page_map.Get_Blocks();
+  return {ptr, count};
+}
+
+template <class Real, int Dim> auto MpmGrid<Real, Dim>::_block_origin(uint64_t block) -> Coord {
+  auto coord = Mask::LinearToCoord(block);
+  return Eigen::Map<const Coord>(coord.data());
+}
+
+template <class Real, int Dim> auto MpmGrid<Real, Dim>::_element_coord(uint32_t element) -> Coord {
+  // inside a block the lowest bits index z (y in 2D), the highest ones x
+  if constexpr (Dim == 3) {
+    constexpr int zbits = Mask::block_zbits, ybits = Mask::block_ybits;
+    return Coord(int(element >> (zbits + ybits)), int((element >> zbits) & ((1u << ybits) - 1)), int(element & ((1u << zbits) - 1)));
+  } else {
+    constexpr int ybits = Mask::block_ybits;
+    return Coord(int(element >> ybits), int(element & ((1u << ybits) - 1)));
+  }
+}
+
+template <class Real, int Dim> template <class TFn> void MpmGrid<Real, Dim>::for_each_node(TFn&& func) {
+  auto active = blocks();
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, active.size()), [&](tbb::blocked_range<size_t> const& r) {
+    for (size_t b = r.begin(); b < r.end(); ++b) {
+      const auto origin = _block_origin(active[b]);
+      for (uint32_t e = 0; e < elements_per_block; ++e) {
+        func(Coord(origin + _element_coord(e)), data(active[b] + e * element_bytes));
+      }
+    }
+  });
+}
+
+template <class Real, int Dim> template <int reach> auto MpmGrid<Real, Dim>::_halo() -> std::vector<HaloNode> const& {
+  static const auto nodes = [] {
+    std::vector<HaloNode> result;
+    for (int index = 0; index < _tile_size; ++index) {
+      Coord local;
+      int outside = 0, neighbor = 0;
+      for (int d = 0, rest = index, weight = 1; d < Dim; rest %= _tile_stride[d], ++d, weight *= 3) {
+        local[d] = rest / _tile_stride[d] - 1;
+        const int side = local[d] < 0 ? 0 : (local[d] < _tile_extent[d] - 2 ? 1 : 2);
+        outside += side != 1;
+        neighbor += side * weight;
+      }
+      if (outside > 0 && outside <= reach) result.push_back({index, offset(local), neighbor});
+    }
+    return result;
+  }();
+  return nodes;
+}
+
+template <class Real, int Dim>
+template <class TStencil, class TIn, class TOut>
+void MpmGrid<Real, Dim>::apply_stencil(std::array<Real, TStencil::size> const& weights, TIn&& in, TOut&& out) {
+  static constexpr auto shifts = [] {
+    std::array<int, TStencil::size> result{};
+    for (int s = 0; s < TStencil::size; ++s) {
+      for (int d = 0; d < Dim; ++d) result[s] += TStencil::offsets[s][d] * _tile_stride[d];
+    }
+    return result;
+  }();
+  static constexpr int reach = [] {
+    int result = 0;
+    for (auto const& offset : TStencil::offsets) result = std::max(result, int(std::count_if(offset.begin(), offset.end(), [](int o) { return o != 0; })));
+    return result;
+  }();
+  static_assert(std::all_of(TStencil::offsets.begin(), TStencil::offsets.end(),
+                            [](auto const& offset) { return std::all_of(offset.begin(), offset.end(), [](int o) { return o >= -1 && o <= 1; }); }),
+                "stencils reach one node along each axis at most");
+
+  auto active = blocks();
+  const auto padded = allocator.Padded_Size();
+  const Coord size = block_size();
+  std::vector<Real> values(active.size() * elements_per_block);
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, active.size()), [&](tbb::blocked_range<size_t> const& r) {
+    std::array<Real, _tile_size> tile;
+    for (size_t b = r.begin(); b < r.end(); ++b) {
+      const uint64_t block = active[b];
+      // the block itself, row by row: consecutive elements run along the last axis
+      for (uint32_t e = 0; e < elements_per_block; e += _row_size) {
+        Real* row = tile.data() + _tile_index(_element_coord(e));
+        for (int i = 0; i < _row_size; ++i) row[i] = in(data(block + (e + i) * element_bytes));
+      }
+      // the halo from the neighbor blocks, zero for those outside the domain or not active
+      const Coord origin = _block_origin(block);
+      std::array<bool, BoxStencil<Dim>::size> live;
+      for (int n = 0; n < BoxStencil<Dim>::size; ++n) {
+        Coord corner = origin;
+        for (int d = 0; d < Dim; ++d) corner[d] += BoxStencil<Dim>::offsets[n][d] * size[d];
+        bool inside = true;
+        for (int d = 0; d < Dim; ++d) inside &= corner[d] >= 0 && corner[d] < int(padded[d]);
+        live[n] = inside && is_active(offset(corner));
+      }
+      for (auto const& node : _halo<reach>()) {
+        tile[node.index] = live[node.neighbor] ? in(data(neighbor(block, node.offset))) : Real(0);
+      }
+      // a row of results at a time, each stencil node adds the same shifted row of the tile
+      Real* result = values.data() + b * elements_per_block;
+      for (uint32_t e = 0; e < elements_per_block; e += _row_size) {
+        const Real* center = tile.data() + _tile_index(_element_coord(e));
+        std::array<Real, _row_size> sum{};
+        for (int s = 0; s < TStencil::size; ++s) {
+          const Real weight = weights[s];
+          const Real* source = center + shifts[s];
+          for (int i = 0; i < _row_size; ++i) sum[i] += weight * source[i];
+        }
+        std::copy(sum.begin(), sum.end(), result + e);
+      }
+    }
+  });
+
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, active.size()), [&](tbb::blocked_range<size_t> const& r) {
+    for (size_t b = r.begin(); b < r.end(); ++b) {
+      const Real* result = values.data() + b * elements_per_block;
+      for (uint32_t e = 0; e < elements_per_block; ++e) out(data(active[b] + e * element_bytes), result[e]);
+    }
+  });
+}
+
+template <class Real, int Dim> void MpmGrid<Real, Dim>::_zero_block(std::byte* block) {
+  // non-temporal stores: the zeros are not read before the next P2G, so they should not evict the
+  // particle data from the caches nor read the block in first
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  auto* lanes = reinterpret_cast<__m128i*>(block);
+  for (uint64_t i = 0; i < block_bytes / sizeof(__m128i); ++i) _mm_stream_si128(lanes + i, zero);
+#else
+  std::memset(block, 0, block_bytes);
+#endif
+}
+
+template <class Real, int Dim> void MpmGrid<Real, Dim>::clear() {
+  auto* base = static_cast<std::byte*>(data.Get_Data_Ptr());
+  auto active = blocks();
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, active.size()), [&](tbb::blocked_range<size_t> const& r) {
+    for (size_t b = r.begin(); b < r.end(); ++b) _zero_block(base + active[b]);
+#if defined(__SSE2__)
+    _mm_sfence();
+#endif
+  });
+  for (const auto block : active) resident.Set_Page(block);
+  if (resident_blocks() * block_bytes > resident_limit) release();
+  page_map.Clear_Active_Blocks();
+}
+
+template <class Real, int Dim> void MpmGrid<Real, Dim>::release() {
+  if (page_policy() == SPGrid::Page_Policy::Explicit_Huge) return;
+  auto* base = static_cast<std::byte*>(data.Get_Data_Ptr());
+  auto [ptr, count] = resident.Get_Blocks();
+  std::vector<uint64_t> freed, kept;
+  freed.reserve(count);
+  for (const auto block : std::span<const uint64_t>(ptr, count)) {
+    if (!page_map.Test_Page(block)) freed.push_back(block);
+  }
+  std::sort(freed.begin(), freed.end());
+
+  // under huge pages the unit of release is a whole 2MB page holding no active block
+  uint64_t unit = block_bytes;
+  if (page_policy() == SPGrid::Page_Policy::Transparent_Huge) {
+    unit = SPGrid::huge_page_size;
+    uint64_t volume_bytes = element_bytes;
+    for (const auto size : allocator.Padded_Size()) volume_bytes *= size;
+    std::vector<uint64_t> pages;
+    for (size_t begin = 0, end = 0; begin < freed.size(); begin = end) {
+      const uint64_t page = freed[begin] & ~(unit - 1);
+      for (end = begin + 1; end < freed.size() && freed[end] < page + unit; ++end) {}
+      bool idle = true;
+      for (uint64_t block = page; idle && block < std::min(page + unit, volume_bytes); block += block_bytes) idle = !page_map.Test_Page(block);
+      if (idle) {
+        pages.push_back(page);
+      } else {
+        kept.insert(kept.end(), freed.begin() + begin, freed.begin() + end);
+      }
+    }
+    freed.swap(pages);
+  }
+
+  // one madvise per run of adjacent units
+  for (size_t begin = 0, end = 0; begin < freed.size(); begin = end) {
+    for (end = begin + 1; end < freed.size() && freed[end] == freed[end - 1] + unit; ++end) {}
+    SPGrid::Deactivate_Page(base + freed[begin], (end - begin) * unit);
+  }
+
+  resident.Clear();
+  for (const auto block : blocks()) resident.Set_Page(block);
+  for (const auto block : kept) resident.Set_Page(block);
+}
+
+#pragma endregion MpmGrid_Definitions
+
+} // namespace sim::mpm
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "math/numeric_types.hpp"
+
+namespace sim::mpm {
+
+// Particle state, one neo_ecs component per quantity. Vector and matrix quantities derive from the
+// fixed-size Eigen types, so a query batch can be viewed with as_matrix() and used in Eigen
+// expressions directly.
+
+template <class Real, int Dim> struct Position : Vec<Real, Dim> {
+  using Base = Vec<Real, Dim>;
+  using Base::Base;
+  using Base::operator=;
+};
+
+template <class Real, int Dim> struct Velocity : Vec<Real, Dim> {
+  using Base = Vec<Real, Dim>;
+  using Base::Base;
+  using Base::operator=;
+};
+
+// APIC affine velocity matrix C
+template <class Real, int Dim> struct AffineVelocity : Mat<Real, Dim, Dim> {
+  using Base = Mat<Real, Dim, Dim>;
+  using Base::Base;
+  using Base::operator=;
+};
+
+// elastic deformation gradient F
+template <class Real, int Dim> struct DeformationGradient : Mat<Real, Dim, Dim> {
+  using Base = Mat<Real, Dim, Dim>;
+  using Base::Base;
+  using Base::operator=;
+};
+
+template <class Real> struct Mass {
+  Real value;
+};
+
+// initial volume V0
+template <class Real> struct Volume {
+  Real value;
+};
+
+} // namespace sim::mpm
@@ -1,11 +1,454 @@
 #pragma once
+#include <tbb/combinable.h>
+#include <tbb/parallel_reduce.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <span>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "ecs/neo_ecs.hpp"
+#include "math/numeric_types.hpp"
+#include "sim/mpm/mpm_force.hpp"
+#include "sim/mpm/mpm_grid.hpp"
+#include "sim/mpm/mpm_particle.hpp"
 #include "sim/simulation.hpp"
+#include "utils/radix_sort.hpp"
 
 namespace sim::mpm {
 
+template <class Real, int Dim> struct MpmConfig {
+  int resolution = 64;       // grid cells across the unit domain
+  int boundary = 3;          // slip walls, in cells from the domain border
+  Real density = 1e3;        // particle density used by add_box
+  Real youngs_modulus = 1e4;
+  Real poisson_ratio = 0.3;
+  Vec<Real, Dim> gravity = Vec<Real, Dim>::Unit(1) * Real(-9.8);
+  Real cfl = 0.5;                   // adaptive dt: fraction of a cell a particle or an elastic wave may cross per step
+  Real min_dt = 1e-6;
+  Real max_dt = 1e-2;
+  int sort_interval = 32;           // reorder particles by grid block every n steps, 0 never reorders
+  double sort_fragmentation = 4.0;  // or earlier, once a block's particles are split into this many runs on average
+  // huge pages for the grid, fewer TLB misses in P2G and G2P. Explicit_Huge reserves hugetlbfs pages for the whole
+  // resolution^Dim domain however sparse the scene is, and falls back to Transparent_Huge if the pool is too small
+  SPGrid::Page_Policy page_policy = SPGrid::Page_Policy::Default;
+  uint64_t resident_grid_bytes = uint64_t(1) << 32;                // cleared grid blocks kept resident for reuse, 0 unmaps them every step
+};
+
+// Moving least squares MPM (Hu et al. 2018) with APIC transfers and quadratic B-splines.
+// Particles live in a neo_ecs World, the grid in an SPGrid allocator over the unit domain.
 template <class Real, int Dim> class MpmSimulation : public Simulation<Real, Dim> {
   using Base = Simulation<Real, Dim>;
-  
+
+public:
+  using TV = Vec<Real, Dim>;
+  using TM = Mat<Real, Dim, Dim>;
+  using Grid = MpmGrid<Real, Dim>;
+  using TPosition = Position<Real, Dim>;
+  using TVelocity = Velocity<Real, Dim>;
+  using TAffine = AffineVelocity<Real, Dim>;
+  using TDeformation = DeformationGradient<Real, Dim>;
+  using TMass = Mass<Real>;
+  using TVolume = Volume<Real>;
+
+  explicit MpmSimulation(MpmConfig<Real, Dim> const& config = {});
+
+  void tick_step(Real dt) override;
+  // CFL step from the fastest particle plus the fastest P-wave speed over the materials holding particles,
+  // hardening included, within [min_dt, max_dt]
+  Real calc_dt() const override;
+  std::string_view sim_name() const override { return "mpm"; }
+
+  // fill the box [lower, upper) with 2^Dim particles per cell of `TMaterial`, at rest unless `velocity` is given
+  template <class TMaterial = FixedCorotated<Real, Dim>> size_t add_box(TV const& lower, TV const& upper, TV const& velocity = TV::Zero());
+
+  // parameters of one of the Materials, shared by all its particles
+  template <class TMaterial> TMaterial& material() { return std::get<TMaterial>(materials); }
+
+  // the three stages of tick_step, public to allow timing them separately.
+  // P2G evaluates stresses in parallel, one kernel per material archetype, buckets particles by the grid block of their lowest
+  // stencil node and scatters block by block, one color at a time: blocks of a color never write
+  // the same node, so no atomics are needed.
+  void p2g(Real dt);
+  // P2G baseline scattering every particle in parallel with atomic adds
+  void p2g_atomic(Real dt);
+  void grid_update(Real dt);
+  void g2p(Real dt);
+
+  // reorder the storage of every particle archetype by the grid block of the lowest stencil node,
+  // so P2G reads its particles block by block and G2P walks the grid in block order
+  void sort_particles();
+
+  // particles [begin, end) of block_particles() have their lowest stencil node in `block`
+  struct BlockRange {
+    uint64_t block;
+    uint32_t begin;
+    uint32_t end;
+  };
+
+  // the occupied blocks of the last P2G, in block order, and the dense particle indices grouped by them
+  std::span<const BlockRange> block_ranges() const { return occupied; }
+  std::span<const uint32_t> block_particles() const { return particle_order; }
+  // storage runs per occupied block in the last P2G, 1 when every block's particles are contiguous
+  double fragmentation() const { return occupied.empty() ? 1.0 : double(block_runs) / double(occupied.size()); }
+
+  // fastest particle speed after the last G2P or add_box
+  Real max_speed() const { return fastest; }
+  // dt of the last `dt_history_size` steps at most, oldest first
+  static constexpr size_t dt_history_size = 256;
+  std::span<const Real> dt_history() const { return std::span<const Real>(steps_taken).last(std::min(steps_taken.size(), dt_history_size)); }
+
+  size_t particle_count() const { return particles.entity_count(); }
+  ecs::World& world() { return particles; }
+  Grid& grid() { return background; }
+  MpmConfig<Real, Dim> const& config() const { return params; }
+
+  // page faults of the whole process during the last tick_step, particle storage included. Once the
+  // grid blocks in use are resident and the particle count is stable, a step should take none
+  uint64_t page_faults() const { return step_faults; }
+
+private:
+  // quadratic B-spline weights of a particle, per axis and per stencil node along that axis
+  struct Kernel {
+    typename Grid::Coord base;
+    TV fx;
+    Mat<Real, Dim, 3> w;
+
+    Kernel(TV const& x, Real inv_dx);
+
+    // weight and (node - particle) distance, in cells, of stencil node `s`
+    Real weight(int s, TV& dpos) const;
+  };
+
+  // P2G input of one particle
+  struct Transfer {
+    TV x;
+    TV momentum;
+    TM affine;
+    Real mass;
+    uint64_t base; // grid offset of the lowest stencil node
+  };
+
+  template <class TMaterial>
+  using MaterialBatch = std::tuple<size_t, std::span<const TPosition>, std::span<const TVelocity>, std::span<const TAffine>, std::span<const TDeformation>,
+                                   std::span<const TMass>, std::span<const TVolume>, std::span<const typename TMaterial::State>>;
+
+  // `func(material)` for each of the Materials
+  template <class TFn> void _for_each_material(TFn&& func);
+  // matched chunks of one material, numbered densely from `count` on
+  template <class TMaterial> std::vector<MaterialBatch<TMaterial>> _collect_batches(TMaterial const& material, size_t& count);
+  template <class TMaterial> void _compute_transfers(TMaterial const& material, std::vector<MaterialBatch<TMaterial>> const& batches, Real stress_scale);
+  void _prepare_p2g(Real dt);
+  // return mapping of every plastic material, after G2P moved F
+  void _project();
+  // largest P-wave speed over the particles of every material, after add_box and each G2P
+  void _update_wave_speed();
+
+  template <bool atomic> void _scatter(Transfer const& particle);
+
+  MpmConfig<Real, Dim> params;
+  Real dx;
+  Real inv_dx;
+  Real wave_speed = 0;
+  Real fastest = 0;
+  Materials<Real, Dim> materials;
+  std::vector<Real> steps_taken; // at most 2 * dt_history_size entries, trimmed in bulk
+
+  ecs::World particles;
+  Grid background;
+  ecs::Query<TPosition, TVelocity, TAffine, TDeformation> g2p_query;
+
+  std::vector<Transfer> transfers;
+  std::vector<TM> stresses;              // Kirchhoff stress of each transfer
+  std::vector<uint64_t> particle_keys;   // block index of each transfer, sorted by the radix sort
+  std::vector<uint32_t> particle_order;  // transfer indices, in the order of particle_keys
+  std::vector<BlockRange> occupied;
+  size_t block_runs = 0;
+  int steps_since_sort = 0;
+  uint64_t step_faults = 0;
+  std::array<std::vector<uint32_t>, Grid::colors> color_blocks; // indices into occupied
 };
 
-} // namespace sim::mpm
\ No newline at end of file
+#pragma region MpmSimulation_Definitions
+
+template <class Real, int Dim> MpmSimulation<Real, Dim>::Kernel::Kernel(TV const& x, Real inv_dx) {
+  const TV xi = x * inv_dx;
+  base = (xi.array() - Real(0.5)).floor().template cast<int>();
+  fx = xi - base.template cast<Real>();
+  w.col(0) = Real(0.5) * (Real(1.5) - fx.array()).square();
+  w.col(1) = Real(0.75) - (fx.array() - Real(1)).square();
+  w.col(2) = Real(0.5) * (fx.array() - Real(0.5)).square();
+}
+
+template <class Real, int Dim> Real MpmSimulation<Real, Dim>::Kernel::weight(int s, TV& dpos) const {
+  Real result = 1;
+  for (int d = 0; d < Dim; ++d, s /= 3) {
+    result *= w(d, s % 3);
+    dpos[d] = Real(s % 3) - fx[d];
+  }
+  return result;
+}
+
+template <class Real, int Dim>
+MpmSimulation<Real, Dim>::MpmSimulation(MpmConfig<Real, Dim> const& config)
+    : params(config),
+      dx(Real(1) / config.resolution),
+      inv_dx(Real(config.resolution)),
+      materials(make_materials<Materials<Real, Dim>>(config.youngs_modulus, config.poisson_ratio)),
+      background(config.resolution, config.page_policy, config.resident_grid_bytes),
+      g2p_query(particles.query<TPosition, TVelocity, TAffine, TDeformation>()) {}
+
+template <class Real, int Dim> template <class TMaterial> size_t MpmSimulation<Real, Dim>::add_box(TV const& lower, TV const& upper, TV const& velocity) {
+  const Real spacing = dx / 2;
+  const Real volume = std::pow(spacing, Dim);
+  const Eigen::Matrix<size_t, Dim, 1> counts = ((upper - lower) / spacing).array().floor().template cast<size_t>();
+  const size_t total = counts.prod();
+
+  particles.spawn_n<TPosition, TVelocity, TAffine, TDeformation, TMass, TVolume, typename TMaterial::State>(total, [&](size_t i) {
+    TV x;
+    for (int d = 0; d < Dim; ++d) {
+      x[d] = lower[d] + (Real(i % counts[d]) + Real(0.5)) * spacing;
+      i /= counts[d];
+    }
+    return std::make_tuple(TPosition(x), TVelocity(velocity), TAffine(TM::Zero()), TDeformation(TM::Identity()), TMass{params.density * volume},
+                           TVolume{volume}, typename TMaterial::State{});
+  });
+  if (total) fastest = std::max(fastest, velocity.norm());
+  _update_wave_speed();
+  return total;
+}
+
+template <class Real, int Dim> Real MpmSimulation<Real, Dim>::calc_dt() const {
+  return std::clamp(params.cfl * dx / (fastest + wave_speed), params.min_dt, params.max_dt);
+}
+
+template <class Real, int Dim> void MpmSimulation<Real, Dim>::tick_step(Real dt) {
+  LOG_DEBUG("Tick Step delta_time: {} (max speed {})", dt, fastest);
+  if (steps_taken.size() == 2 * dt_history_size) steps_taken.erase(steps_taken.begin(), steps_taken.begin() + dt_history_size);
+  steps_taken.push_back(dt);
+  if (params.sort_interval > 0 && (++steps_since_sort >= params.sort_interval || fragmentation() > params.sort_fragmentation)) sort_particles();
+  const auto faults = SPGrid::Page_Faults();
+  background.clear();
+  p2g(dt);
+  grid_update(dt);
+  g2p(dt);
+  step_faults = SPGrid::Page_Faults() - faults;
+}
+
+template <class Real, int Dim> void MpmSimulation<Real, Dim>::sort_particles() {
+  steps_since_sort = 0;
+  std::vector<uint64_t> keys;
+  std::vector<uint32_t> order;
+  for (auto* table : particles.query_cache<TPosition, TVelocity, TAffine, TDeformation, TMass, TVolume>().tables) {
+    auto& positions = table->template typed_row<TPosition>();
+    keys.resize(table->cols());
+    order.resize(table->cols());
+    tbb::parallel_for(size_t(0), positions.chunk_count(), [&](size_t c) {
+      const auto* xs = positions.template chunk<TPosition>(c);
+      const auto first = c << data::Column::chunk_bits;
+      for (size_t i = 0; i < positions.chunk_rows(c); ++i) {
+        keys[first + i] = Grid::block_of(Grid::offset(Kernel(xs[i], inv_dx).base)) / Grid::block_bytes;
+        order[first + i] = uint32_t(first + i);
+      }
+    });
+    utils::parallel_radix_sort(keys, order);
+    table->permute(order);
+  }
+}
+
+template <class Real, int Dim> template <class TFn> void MpmSimulation<Real, Dim>::_for_each_material(TFn&& func) {
+  std::apply([&](auto&... material) { (func(material), ...); }, materials);
+}
+
+template <class Real, int Dim>
+template <class TMaterial>
+auto MpmSimulation<Real, Dim>::_collect_batches(TMaterial const&, size_t& count) -> std::vector<MaterialBatch<TMaterial>> {
+  std::vector<MaterialBatch<TMaterial>> batches;
+  particles.query<const TPosition, const TVelocity, const TAffine, const TDeformation, const TMass, const TVolume, const typename TMaterial::State>()
+      .for_each_batch([&](auto xs, auto vs, auto Cs, auto Fs, auto ms, auto vols, auto states) {
+        batches.emplace_back(count, xs, vs, Cs, Fs, ms, vols, states);
+        count += xs.size();
+      });
+  return batches;
+}
+
+template <class Real, int Dim>
+template <class TMaterial>
+void MpmSimulation<Real, Dim>::_compute_transfers(TMaterial const& material, std::vector<MaterialBatch<TMaterial>> const& batches, Real stress_scale) {
+  tbb::parallel_for(size_t(0), batches.size(), [&](size_t b) {
+    auto& [first, xs, vs, Cs, Fs, ms, vols, states] = batches[b];
+    const std::span<TM> taus(stresses.data() + first, xs.size());
+    kirchhoff_batch(material, Fs, states, taus);
+    for (size_t i = 0; i < xs.size(); ++i) {
+      const auto base = Grid::offset(Kernel(xs[i], inv_dx).base);
+      const Real m = ms[i].value;
+      transfers[first + i] = {
+          .x = xs[i],
+          .momentum = m * vs[i],
+          .affine = stress_scale * vols[i].value * taus[i] + m * Cs[i],
+          .mass = m,
+          .base = base,
+      };
+      particle_keys[first + i] = Grid::block_of(base) / Grid::block_bytes;
+      particle_order[first + i] = uint32_t(first + i);
+    }
+  });
+}
+
+template <class Real, int Dim> void MpmSimulation<Real, Dim>::_prepare_p2g(Real dt) {
+  // MLS-MPM fuses the stress divergence into the APIC affine term: D^-1 = 4 / dx^2 for quadratic splines
+  const Real stress_scale = -dt * 4 * inv_dx * inv_dx;
+
+  // collect the matched chunks of every material first so every particle gets a dense index
+  size_t count = 0;
+  auto batches = [&]<class... TMaterial>(std::tuple<TMaterial...>& list) {
+    return std::tuple{_collect_batches(std::get<TMaterial>(list), count)...};
+  }(materials);
+  transfers.resize(count);
+  stresses.resize(count);
+  particle_keys.resize(count);
+  particle_order.resize(count);
+
+  [&]<size_t... I>(std::index_sequence<I...>) {
+    (_compute_transfers(std::get<I>(materials), std::get<I>(batches), stress_scale), ...);
+  }(std::make_index_sequence<std::tuple_size_v<Materials<Real, Dim>>>{});
+  block_runs = tbb::parallel_reduce(
+      tbb::blocked_range<size_t>(0, count), size_t(0),
+      [&](tbb::blocked_range<size_t> const& r, size_t runs) {
+        for (auto i = r.begin(); i < r.end(); ++i) runs += i == 0 || particle_keys[i] != particle_keys[i - 1];
+        return runs;
+      },
+      std::plus<>());
+  utils::parallel_radix_sort(particle_keys, particle_order);
+
+  occupied.clear();
+  for (auto& blocks : color_blocks) blocks.clear();
+  for (uint32_t begin = 0, end = 0; begin < count; begin = end) {
+    for (end = begin; end < count && particle_keys[end] == particle_keys[begin]; ++end) {}
+    const auto block = particle_keys[begin] * Grid::block_bytes;
+    color_blocks[Grid::block_color(block)].emplace_back(uint32_t(occupied.size()));
+    occupied.push_back({.block = block, .begin = begin, .end = end});
+  }
+  // the stencil of these particles reaches into the next block along every axis
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, occupied.size()), [&](tbb::blocked_range<size_t> const& r) {
+    for (size_t b = r.begin(); b < r.end(); ++b)
+      for (int axes = 0; axes < Grid::colors; ++axes) background.activate_concurrent(Grid::next_block(occupied[b].block, axes));
+  });
+  background.commit_blocks();
+}
+
+template <class Real, int Dim> template <bool atomic> void MpmSimulation<Real, Dim>::_scatter(Transfer const& particle) {
+  const auto& stencil = Grid::stencil();
+  const Kernel kernel(particle.x, inv_dx);
+
+  TV dpos;
+  for (int s = 0; s < Grid::stencil_size; ++s) {
+    const Real weight = kernel.weight(s, dpos);
+    auto& node = background(Grid::neighbor(particle.base, stencil[s]));
+    const TV momentum = weight * (particle.momentum + particle.affine * (dpos * dx));
+    if constexpr (atomic) {
+      for (int d = 0; d < Dim; ++d) std::atomic_ref<Real>(node.velocity[d]).fetch_add(momentum[d], std::memory_order_relaxed);
+      std::atomic_ref<Real>(node.mass).fetch_add(weight * particle.mass, std::memory_order_relaxed);
+    } else {
+      node.velocity += momentum;
+      node.mass += weight * particle.mass;
+    }
+  }
+}
+
+template <class Real, int Dim> void MpmSimulation<Real, Dim>::p2g(Real dt) {
+  _prepare_p2g(dt);
+  for (auto const& blocks : color_blocks) {
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, blocks.size()), [&](tbb::blocked_range<size_t> const& r) {
+      for (size_t bi = r.begin(); bi < r.end(); ++bi) {
+        auto const& range = occupied[blocks[bi]];
+        for (auto p = range.begin; p < range.end; ++p) _scatter<false>(transfers[particle_order[p]]);
+      }
+    });
+  }
+}
+
+template <class Real, int Dim> void MpmSimulation<Real, Dim>::p2g_atomic(Real dt) {
+  _prepare_p2g(dt);
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, transfers.size()), [&](tbb::blocked_range<size_t> const& r) {
+    for (size_t p = r.begin(); p < r.end(); ++p) _scatter<true>(transfers[p]);
+  });
+}
+
+template <class Real, int Dim> void MpmSimulation<Real, Dim>::grid_update(Real dt) {
+  const TV gravity = params.gravity * dt;
+  const int lower = params.boundary;
+  const int upper = params.resolution - params.boundary;
+
+  background.for_each_node([&](typename Grid::Coord const& coord, typename Grid::Node& node) {
+    if (node.mass <= 0) return;
+    node.velocity = node.velocity / node.mass + gravity;
+    for (int d = 0; d < Dim; ++d) {
+      if ((coord[d] < lower && node.velocity[d] < 0) || (coord[d] > upper && node.velocity[d] > 0)) node.velocity[d] = 0;
+    }
+  });
+}
+
+template <class Real, int Dim> void MpmSimulation<Real, Dim>::g2p(Real dt) {
+  const auto& stencil = Grid::stencil();
+
+  // grid is read-only here, particles are updated independently; the fastest speed is reduced on the way for calc_dt
+  tbb::combinable<Real> speeds([] { return Real(0); });
+  g2p_query.par_for_each_chunk([&](std::span<TPosition> xs, std::span<TVelocity> vs, std::span<TAffine> Cs, std::span<TDeformation> Fs) {
+    Real speed2 = 0;
+    for (size_t p = 0; p < xs.size(); ++p) {
+      const Kernel kernel(xs[p], inv_dx);
+      const auto base = Grid::offset(kernel.base);
+
+      TV v = TV::Zero();
+      TM C = TM::Zero();
+      TV dpos;
+      for (int s = 0; s < Grid::stencil_size; ++s) {
+        const Real weight = kernel.weight(s, dpos);
+        const TV node_v = background(Grid::neighbor(base, stencil[s])).velocity;
+        v += weight * node_v;
+        C += (4 * inv_dx * weight) * node_v * dpos.transpose();
+      }
+
+      vs[p] = v;
+      Cs[p] = C;
+      xs[p] += dt * v;
+      Fs[p] = (TM::Identity() + dt * C) * Fs[p];
+      speed2 = std::max(speed2, v.squaredNorm());
+    }
+    speeds.local() = std::max(speeds.local(), speed2);
+  });
+  fastest = std::sqrt(speeds.combine([](Real a, Real b) { return std::max(a, b); }));
+  _project();
+  _update_wave_speed();
+}
+
+template <class Real, int Dim> void MpmSimulation<Real, Dim>::_project() {
+  _for_each_material([&](auto const& material) {
+    using TMaterial = std::remove_cvref_t<decltype(material)>;
+    using TState = typename TMaterial::State;
+    if constexpr (TMaterial::plastic) {
+      particles.query<TDeformation, TState>().par_for_each_chunk(
+          [&](std::span<TDeformation> Fs, std::span<TState> states) { project_batch(material, Fs, states); });
+    }
+  });
+}
+
+template <class Real, int Dim> void MpmSimulation<Real, Dim>::_update_wave_speed() {
+  // materials without particles add nothing, the plastic state may stiffen a material over time
+  tbb::combinable<Real> moduli([] { return Real(0); });
+  _for_each_material([&](auto const& material) {
+    using TState = typename std::remove_cvref_t<decltype(material)>::State;
+    particles.query<const TState>().par_for_each_chunk(
+        [&](std::span<const TState> states) { moduli.local() = std::max(moduli.local(), max_wave_modulus(material, states)); });
+  });
+  wave_speed = std::sqrt(moduli.combine([](Real a, Real b) { return std::max(a, b); }) / params.density);
+}
+
+#pragma endregion MpmSimulation_Definitions
+
+} // namespace sim::mpm
@@ -27,13 +27,14 @@ template <class Real, int Dim>
 void Simulation<Real, Dim>::execute(int32_t start_frame, int32_t end_frame) {
   reload(start_frame - 1);
   for (int i = start_frame; i < end_frame; ++i) {
-    tick_frame(start_frame);
+    tick_frame(i);
   }
 }
 
 template <class Real, int Dim> void Simulation<Real, Dim>::tick_frame(int32_t frame_idx) {
   const Real frame_time = 1. / frame_rate;
   Real sum_dt = 0;
+  int32_t substeps = 0;
 
   LOG_INFO("Tick Frame {}", frame_idx);
 
@@ -47,8 +48,10 @@ template <class Real, int Dim> void Simulation<Real, Dim>::tick_frame(int32_t fr
 
     tick_step(dt);
     sum_dt += dt;
+    ++substeps;
   }
 
+  LOG_INFO("Frame {} took {} substeps", frame_idx, substeps);
   write(frame_idx);
 }
 
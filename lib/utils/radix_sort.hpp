@@ -0,0 +1,66 @@
+#pragma once
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace sim::utils {
+
+// Stable LSD radix sort of (key, value) pairs, 8 bits per pass. Only the passes covering the
+// largest key run, and a pass whose digit is the same for every key is skipped. Each pass counts
+// digits per tile, prefix-sums the counts digit-major and scatters the tiles in parallel.
+template <class TValue> void parallel_radix_sort(std::vector<uint64_t>& keys, std::vector<TValue>& values) {
+  constexpr int radix_bits = 8;
+  constexpr size_t buckets = size_t(1) << radix_bits;
+  constexpr size_t tile_size = size_t(1) << 14;
+
+  const size_t count = keys.size();
+  if (count < 2) return;
+  const size_t tiles = (count + tile_size - 1) / tile_size;
+  const uint64_t max_key = tbb::parallel_reduce(
+      tbb::blocked_range<size_t>(0, count), uint64_t(0),
+      [&](tbb::blocked_range<size_t> const& r, uint64_t result) { return std::max(result, *std::max_element(keys.begin() + r.begin(), keys.begin() + r.end())); },
+      [](uint64_t a, uint64_t b) { return std::max(a, b); });
+  const int passes = (std::bit_width(max_key) + radix_bits - 1) / radix_bits;
+
+  std::vector<uint64_t> key_buffer(count);
+  std::vector<TValue> value_buffer(count);
+  std::vector<std::array<size_t, buckets>> offsets(tiles);
+  for (int pass = 0; pass < passes; ++pass) {
+    const int shift = pass * radix_bits;
+    tbb::parallel_for(size_t(0), tiles, [&](size_t t) {
+      auto& counts = offsets[t];
+      counts.fill(0);
+      for (size_t i = t * tile_size, end = std::min(count, i + tile_size); i < end; ++i) ++counts[(keys[i] >> shift) & (buckets - 1)];
+    });
+
+    // tile t writes digit d right after digit d of the tiles before it
+    size_t total = 0;
+    bool uniform = false;
+    for (size_t d = 0; d < buckets; ++d) {
+      const size_t digit_begin = total;
+      for (auto& counts : offsets) total += std::exchange(counts[d], total);
+      uniform |= total - digit_begin == count;
+    }
+    if (uniform) continue;
+
+    tbb::parallel_for(size_t(0), tiles, [&](size_t t) {
+      auto& cursor = offsets[t];
+      for (size_t i = t * tile_size, end = std::min(count, i + tile_size); i < end; ++i) {
+        const auto pos = cursor[(keys[i] >> shift) & (buckets - 1)]++;
+        key_buffer[pos] = keys[i];
+        value_buffer[pos] = values[i];
+      }
+    });
+    keys.swap(key_buffer);
+    values.swap(value_buffer);
+  }
+}
+
+} // namespace sim::utils
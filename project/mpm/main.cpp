@@ -4,5 +4,6 @@
 int main() {
   using namespace sim::mpm;
   MpmSimulation<double, 3> mpm;
+  mpm.add_box({0.4, 0.6, 0.4}, {0.6, 0.8, 0.6});
   mpm.execute(0, 1);
-}
\ No newline at end of file
+}
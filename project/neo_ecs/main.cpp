@@ -21,7 +21,7 @@ void test_neo_ecs() {
   using A = float;
   using B = int;
   sim::ecs::World world;
-  auto& ent = world.entity<A, B>();
+  auto ent = world.entity<A, B>();
 
   ent.add(A{1.1234}, B{233}, std::string{"str"}, double{4.1231});
   auto [d, c, x, y, b, a] = ent.get<A,B,std::string, double, B,A>();
@@ -126,9 +126,7 @@ double test_NEO_ECS() {
   double total_p{0};
   {
     SCOPED_TIMER("NEO_ECS::init");
-    for (size_t i = 0; i < N; ++i) {
-      world.entity<Position, Velocity, Force, Mass>({0}, {0}, {1.0f, 1.0f, 1.0f}, {1.0f});
-    }
+    world.spawn_n<Position, Velocity, Force, Mass>(N, [](size_t) { return std::make_tuple(Position{0, 0, 0}, Velocity{0, 0, 0}, Force{1.0f, 1.0f, 1.0f}, Mass{1.0f}); });
   }
   auto Q = world.query<Position, Velocity, Force, Mass>();
   {
@@ -159,6 +157,57 @@ double test_NEO_ECS() {
   return total_p;
 }
 
+#include "math/numeric_types.hpp"
+
+// Eigen backed components, one distinct type per role
+template <int D, int Role>
+struct VecComponent : sim::Vec<float, D> {
+  using Base = sim::Vec<float, D>;
+  using Base::Base;
+  using Base::operator=;
+};
+
+using BatchPosition = VecComponent<3, 0>;
+using BatchVelocity = VecComponent<3, 1>;
+using BatchForce = VecComponent<3, 2>;
+using BatchMass = VecComponent<1, 3>;
+
+double test_NEO_ECS_BATCH() {
+  FUNCTION_TIMER();
+  using namespace sim;
+  ecs::World world;
+  double total_p{0};
+  {
+    SCOPED_TIMER("NEO_ECS_BATCH::init");
+    world.spawn_n<BatchPosition, BatchVelocity, BatchForce, BatchMass>(N, [](size_t) {
+      return std::make_tuple(BatchPosition(0.0f, 0.0f, 0.0f), BatchVelocity(0.0f, 0.0f, 0.0f), BatchForce(1.0f, 1.0f, 1.0f), BatchMass(1.0f));
+    });
+  }
+  auto Q = world.query<BatchPosition, BatchVelocity, BatchForce, BatchMass>();
+  {
+    SCOPED_TIMER("NEO_ECS_BATCH::simulation");
+    for (size_t t = 0; t < STEPS; ++t) {
+      Q.for_each_batch([](std::span<BatchPosition> p, std::span<BatchVelocity> v, std::span<BatchForce> f, std::span<BatchMass> m) {
+        auto P = as_matrix(p);
+        auto V = as_matrix(v);
+        auto F = as_matrix(f);
+        auto M = as_matrix(m);
+        F.row(1) *= 0.95f;
+        V.array() += F.array().rowwise() * M.array();
+        P += V;
+      });
+    }
+  }
+  {
+    SCOPED_TIMER("NEO_ECS_BATCH::summary");
+    Q.for_each([&total_p](auto& p, auto& v, auto& f, auto& m) {
+      total_p += p.x() + p.y() + p.z() + v.x() + v.y() + v.z();
+      v += f * m.x();
+    });
+  }
+  return total_p;
+}
+
 #endif
 
 #ifdef TEST_OLD_ECS
@@ -260,7 +309,10 @@ int main() {
 
   LOG_INFO("total_p is {} from test_AOS", test_AOS());
   LOG_INFO("total_p is {} from test_SOA", test_SOA());
-  // LOG_INFO("total_p is {} from test_neo_ecs", test_NEO_ECS());
+#ifdef TEST_NEO_ECS
+  LOG_INFO("total_p is {} from test_neo_ecs", test_NEO_ECS());
+  LOG_INFO("total_p is {} from test_neo_ecs_batch", test_NEO_ECS_BATCH());
+#endif
   // LOG_INFO("total_p is {} from test_ECS", test_ECS());
   // LOG_INFO("total_p is {} from test_FLECS", test_FLECS());
 
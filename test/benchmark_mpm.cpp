@@ -0,0 +1,396 @@
+#include "sim/mpm/mpm_simulation.hpp"
+#include "utils/logger.hpp"
+#include "utils/timer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include <tbb/task_arena.h>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static constexpr int RESOLUTION = 128;
+static constexpr size_t STEPS = 20;
+
+// the comparisons below must hold in Release builds too, unlike assert()
+#define CHECK(cond)                                                 \
+  do {                                                              \
+    if (!(cond)) {                                                  \
+      LOG_ERROR("{}:{}: check failed: {}", __FILE__, __LINE__, #cond); \
+      std::abort();                                                 \
+    }                                                               \
+  } while (0)
+
+struct StageTimes {
+  double clear{}, p2g{}, grid{}, g2p{};
+
+  double total() const { return clear + p2g + grid + g2p; }
+};
+
+template <class TFn> double seconds(TFn&& func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// particle-steps per second of a falling block, split by stage
+template <class Real, int Dim> void bench_mpm(const char* name) {
+  using namespace sim::mpm;
+  using Sim = MpmSimulation<Real, Dim>;
+  using TV = typename Sim::TV;
+
+  MpmConfig<Real, Dim> config;
+  config.resolution = RESOLUTION;
+  Sim sim(config);
+  size_t particles{};
+  {
+    SCOPED_TIMER("MPM::init");
+    particles = sim.add_box(TV::Constant(Real(0.3)), TV::Constant(Real(0.7)), TV::Unit(0) * Real(0.5));
+  }
+
+  const Real dt = 1e-4;
+  StageTimes times;
+  for (size_t step = 0; step < STEPS; ++step) {
+    times.clear += seconds([&] { sim.grid().clear(); });
+    times.p2g += seconds([&] { sim.p2g(dt); });
+    times.grid += seconds([&] { sim.grid_update(dt); });
+    times.g2p += seconds([&] { sim.g2p(dt); });
+  }
+
+  const double work = double(particles) * STEPS;
+  LOG_INFO("{}: {} particles, {} active blocks, {} steps", name, particles, sim.grid().blocks().size(), STEPS);
+  LOG_INFO("{}: clear {:.3f}s p2g {:.3f}s grid {:.3f}s g2p {:.3f}s", name, times.clear, times.p2g, times.grid, times.g2p);
+  LOG_INFO("{}: {:.3e} particles/s (p2g {:.3e}, g2p {:.3e})", name, work / times.total(), work / times.p2g, work / times.g2p);
+}
+
+// a small block in a 1024^3 domain: every stage, clearing included, should cost about the same as
+// for the same particles in a small domain
+template <class Real, int Dim> void bench_sparse(const char* name, int resolution) {
+  using namespace sim::mpm;
+  using Sim = MpmSimulation<Real, Dim>;
+  using TV = typename Sim::TV;
+
+  MpmConfig<Real, Dim> config;
+  config.resolution = resolution;
+  Sim sim(config);
+  const Real extent = Real(48) / Real(resolution);
+  const auto particles = sim.add_box(TV::Constant(Real(0.5)), TV::Constant(Real(0.5) + extent), TV::Unit(0) * Real(0.5));
+
+  const Real dt = 1e-5;
+  StageTimes times;
+  for (size_t step = 0; step < STEPS; ++step) {
+    times.clear += seconds([&] { sim.grid().clear(); });
+    times.p2g += seconds([&] { sim.p2g(dt); });
+    times.grid += seconds([&] { sim.grid_update(dt); });
+    times.g2p += seconds([&] { sim.g2p(dt); });
+  }
+
+  LOG_INFO("{} {}^{}: {} particles, {} active blocks", name, resolution, Dim, particles, sim.grid().blocks().size());
+  LOG_INFO("{} {}^{}: per step clear {:.2e}s p2g {:.2e}s grid {:.2e}s g2p {:.2e}s", name, resolution, Dim, times.clear / STEPS, times.p2g / STEPS,
+           times.grid / STEPS, times.g2p / STEPS);
+}
+
+// data TLB load misses of the calling thread, -1 where perf events are unavailable
+class DtlbMisses {
+public:
+  DtlbMisses() {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+  ~DtlbMisses() {
+    if (fd >= 0) close(fd);
+  }
+
+  template <class TFn> long long measure(TFn&& func) {
+    if (fd < 0) {
+      func();
+      return -1;
+    }
+    long long count{};
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    func();
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    return read(fd, &count, sizeof(count)) == sizeof(count) ? count : -1;
+  }
+
+private:
+  int fd;
+};
+
+// P2G of a sparse block in a 1024^3 domain with the grid on 4KB pages against huge pages. The
+// counter only sees its own thread, so P2G runs single-threaded here
+template <class Real, int Dim> void bench_page_policy(const char* name, SPGrid::Page_Policy policy) {
+  using namespace sim::mpm;
+  using Sim = MpmSimulation<Real, Dim>;
+  using TV = typename Sim::TV;
+
+  static constexpr const char* policies[] = {"Default", "Transparent_Huge", "Explicit_Huge"};
+  MpmConfig<Real, Dim> config;
+  config.resolution = 1024;
+  config.page_policy = policy;
+  Sim sim(config);
+  const auto particles = sim.add_box(TV::Constant(Real(0.4)), TV::Constant(Real(0.5)), TV::Unit(0) * Real(0.5));
+
+  const Real dt = 1e-5;
+  tbb::task_arena serial(1);
+  DtlbMisses counter;
+  double p2g{};
+  long long misses{};
+  bool counted = true;
+  for (size_t step = 0; step < STEPS; ++step) {
+    sim.grid().clear();
+    const auto count = serial.execute([&] { return counter.measure([&] { p2g += seconds([&] { sim.p2g(dt); }); }); });
+    counted &= count >= 0;
+    misses += count;
+  }
+
+  const double work = double(particles) * STEPS;
+  const auto obtained = policies[int(sim.grid().page_policy())];
+  if (counted) {
+    LOG_INFO("{} {} (requested {}): {:.3e} particles/s, {:.3f} dTLB load misses per particle", name, obtained, policies[int(policy)], work / p2g,
+             misses / work);
+  } else {
+    LOG_INFO("{} {} (requested {}): {:.3e} particles/s, perf events unavailable", name, obtained, policies[int(policy)], work / p2g);
+  }
+}
+
+// page faults per step of a 256^3 grid whose active nodes alternate between two 64^3 boxes, with
+// cleared blocks recycled or returned to the OS at every clear (resident limit 0). Under huge pages
+// the release must only drop whole idle 2MB pages
+template <class Real> void bench_recycling(const char* name, uint64_t resident_limit, SPGrid::Page_Policy policy = SPGrid::Page_Policy::Default) {
+  using Grid = sim::mpm::MpmGrid<Real, 3>;
+  static constexpr const char* policies[] = {"Default", "Transparent_Huge", "Explicit_Huge"};
+  Grid grid(256, policy, resident_limit);
+
+  uint64_t faults{};
+  double time{};
+  for (size_t step = 0; step < STEPS; ++step) {
+    const int lower = step % 2 ? 32 : 160;
+    const auto before = SPGrid::Page_Faults();
+    time += seconds([&] {
+      grid.clear();
+      for (int x = lower; x < lower + 64; ++x)
+        for (int y = lower; y < lower + 64; ++y)
+          for (int z = lower; z < lower + 64; ++z) {
+            const auto offset = Grid::offset(typename Grid::Coord(x, y, z));
+            grid.activate(offset);
+            grid(offset).mass += Real(1);
+          }
+    });
+    if (step >= 2) faults += SPGrid::Page_Faults() - before; // both boxes touched once
+  }
+
+  LOG_INFO("{} {} resident limit {}: {:.1f} page faults per step, {} resident blocks, {:.2e}s per step", name, policies[int(grid.page_policy())],
+           resident_limit, double(faults) / (STEPS - 2), grid.resident_blocks(), time / STEPS);
+}
+
+// apply_stencil() against a per-node loop with packed-offset lookups for every neighbor, both
+// smoothing the P2G mass of a box; the results must agree
+template <class TStencil, class Real, int Dim> void bench_stencil(const char* name) {
+  using namespace sim::mpm;
+  using Sim = MpmSimulation<Real, Dim>;
+  using Grid = typename Sim::Grid;
+  using TV = typename Sim::TV;
+
+  MpmConfig<Real, Dim> config;
+  config.resolution = RESOLUTION;
+  Sim sim(config);
+  const auto particles = sim.add_box(TV::Constant(Real(0.3)), TV::Constant(Real(0.7)));
+  sim.p2g(Real(1e-4));
+  auto& grid = sim.grid();
+
+  std::array<Real, TStencil::size> weights;
+  weights.fill(Real(1) / TStencil::size);
+  std::array<uint64_t, TStencil::size> shifts;
+  for (int s = 0; s < TStencil::size; ++s) shifts[s] = Grid::offset(Eigen::Map<const typename Grid::Coord>(TStencil::offsets[s].data()));
+
+  // velocity[0] and velocity[1] receive the two results
+  const double tiled = seconds([&] {
+    for (size_t i = 0; i < STEPS; ++i) {
+      grid.template apply_stencil<TStencil>(weights, [](auto const& node) { return node.mass; }, [](auto& node, Real value) { node.velocity[0] = value; });
+    }
+  });
+  const double per_node = seconds([&] {
+    for (size_t i = 0; i < STEPS; ++i) {
+      grid.for_each_node([&](typename Grid::Coord const& coord, typename Grid::Node& node) {
+        Real sum = 0;
+        for (int s = 0; s < TStencil::size; ++s) {
+          const typename Grid::Coord neighbor = coord + Eigen::Map<const typename Grid::Coord>(TStencil::offsets[s].data());
+          if ((neighbor.array() < 0).any()) continue;
+          const auto offset = Grid::neighbor(Grid::offset(coord), shifts[s]);
+          if (grid.is_active(offset)) sum += weights[s] * grid(offset).mass;
+        }
+        node.velocity[1] = sum;
+      });
+    }
+  });
+
+  Real error = 0, scale = 0;
+  grid.for_each_node([&](typename Grid::Coord const&, typename Grid::Node& node) {
+    error = std::max(error, std::abs(node.velocity[0] - node.velocity[1]));
+    scale = std::max(scale, node.mass);
+  });
+  const double nodes = double(grid.blocks().size()) * Grid::elements_per_block * STEPS;
+  LOG_INFO("{}: {} particles, tiled {:.3e} nodes/s, per node {:.3e} nodes/s, max difference {:.2e}", name, particles, nodes / tiled, nodes / per_node, error);
+  CHECK(error <= Real(16) * std::numeric_limits<Real>::epsilon() * scale);
+}
+
+// full steps of a falling block of one material, the stress and return mapping kernels differ
+template <class TMaterial, class Real, int Dim> void bench_material(const char* name) {
+  using namespace sim::mpm;
+  using Sim = MpmSimulation<Real, Dim>;
+  using TV = typename Sim::TV;
+
+  MpmConfig<Real, Dim> config;
+  config.resolution = RESOLUTION / 2;
+  Sim sim(config);
+  const auto particles = sim.template add_box<TMaterial>(TV::Constant(Real(0.3)), TV::Constant(Real(0.7)), TV::Unit(1) * Real(-1));
+
+  const Real dt = 1e-4;
+  const double time = seconds([&] {
+    for (size_t step = 0; step < STEPS; ++step) sim.tick_step(dt);
+  });
+  LOG_INFO("{}: {:.3e} particles/s, {} page faults in the last step", name, double(particles) * STEPS / time, sim.page_faults());
+}
+
+// block-colored scatter against the atomic-add baseline, both include the stress pass. The two
+// grids must agree node by node, and blocks of one color must never write the same block
+template <class Real, int Dim> void bench_p2g(const char* name) {
+  using namespace sim::mpm;
+  using Sim = MpmSimulation<Real, Dim>;
+  using Grid = typename Sim::Grid;
+  using TV = typename Sim::TV;
+
+  MpmConfig<Real, Dim> config;
+  config.resolution = RESOLUTION;
+  Sim sim(config);
+  const auto particles = sim.add_box(TV::Constant(Real(0.3)), TV::Constant(Real(0.7)));
+  auto& grid = sim.grid();
+
+  // every node of the active blocks, in offset order
+  auto snapshot = [&grid] {
+    std::vector<uint64_t> blocks(grid.blocks().begin(), grid.blocks().end());
+    std::sort(blocks.begin(), blocks.end());
+    std::vector<std::pair<uint64_t, typename Grid::Node>> nodes;
+    nodes.reserve(blocks.size() * Grid::elements_per_block);
+    for (const auto block : blocks)
+      for (uint64_t e = 0; e < Grid::elements_per_block; ++e) nodes.emplace_back(block + e * Grid::element_bytes, grid(block + e * Grid::element_bytes));
+    return nodes;
+  };
+
+  const Real dt = 1e-4;
+  double colored{}, atomic{};
+  std::vector<std::pair<uint64_t, typename Grid::Node>> colored_nodes, atomic_nodes;
+  for (size_t step = 0; step < STEPS; ++step) {
+    grid.clear();
+    colored += seconds([&] { sim.p2g(dt); });
+    if (step + 1 == STEPS) colored_nodes = snapshot();
+    grid.clear();
+    atomic += seconds([&] { sim.p2g_atomic(dt); });
+    if (step + 1 == STEPS) atomic_nodes = snapshot();
+  }
+
+  Real error = colored_nodes.size() == atomic_nodes.size() ? 0 : std::numeric_limits<Real>::infinity();
+  Real scale = 0;
+  for (size_t i = 0; i < std::min(colored_nodes.size(), atomic_nodes.size()); ++i) {
+    auto const& [offset, node] = colored_nodes[i];
+    auto const& [other_offset, other] = atomic_nodes[i];
+    if (offset != other_offset) {
+      error = std::numeric_limits<Real>::infinity();
+      break;
+    }
+    error = std::max({error, std::abs(node.mass - other.mass), (node.velocity - other.velocity).cwiseAbs().maxCoeff()});
+    scale = std::max({scale, std::abs(other.mass), other.velocity.cwiseAbs().maxCoeff()});
+  }
+  // only the summation order differs between the two scatters
+  const Real tolerance = Real(1000) * std::numeric_limits<Real>::epsilon() * scale;
+
+  // a block scatters into itself and its next blocks along every axis; count the written blocks
+  // claimed by two blocks of the same color
+  std::unordered_map<uint64_t, std::array<int, Grid::colors>> writers;
+  size_t conflicts = 0;
+  for (auto const& range : sim.block_ranges()) {
+    const int color = Grid::block_color(range.block);
+    for (int axes = 0; axes < Grid::colors; ++axes) conflicts += writers[Grid::next_block(range.block, axes)][color]++ > 0;
+  }
+
+  const double work = double(particles) * STEPS;
+  LOG_INFO("{}: p2g colored {:.3e} particles/s, atomic {:.3e} particles/s, max node difference {:.2e}, {} same-color conflicts", name, work / colored,
+           work / atomic, error, conflicts);
+  CHECK(conflicts == 0);
+  CHECK(error <= tolerance);
+}
+
+// full steps of a moving block, particles kept in spawn order (interval 0) or reordered by block
+template <class Real, int Dim> void bench_sort(const char* name, int sort_interval) {
+  using namespace sim::mpm;
+  using Sim = MpmSimulation<Real, Dim>;
+  using TV = typename Sim::TV;
+
+  MpmConfig<Real, Dim> config;
+  config.resolution = RESOLUTION;
+  config.sort_interval = sort_interval;
+  Sim sim(config);
+  const auto particles = sim.add_box(TV::Constant(Real(0.3)), TV::Constant(Real(0.7)), TV::Unit(0) * Real(0.5));
+
+  const Real dt = 1e-4;
+  double step{};
+  for (size_t i = 0; i < STEPS; ++i) step += seconds([&] { sim.tick_step(dt); });
+  const double fragmentation = sim.fragmentation();
+  const double sort = seconds([&] { sim.sort_particles(); });
+
+  const double work = double(particles) * STEPS;
+  LOG_INFO("{} sort_interval {}: {:.3e} particles/s, one sort {:.3f}s, fragmentation {:.2f}", name, sort_interval, work / step, sort, fragmentation);
+}
+
+int main() {
+  LOG_INFO("Start MLS-MPM throughput benchmark...");
+
+  bench_mpm<float, 3>("MPM<float, 3>");
+  bench_mpm<double, 3>("MPM<double, 3>");
+  bench_mpm<double, 2>("MPM<double, 2>");
+
+  bench_sparse<float, 3>("Sparse<float, 3>", 128);
+  bench_sparse<float, 3>("Sparse<float, 3>", 1024);
+
+  bench_p2g<float, 3>("P2G<float, 3>");
+  bench_p2g<double, 3>("P2G<double, 3>");
+
+  bench_page_policy<float, 3>("Pages<float, 3>", SPGrid::Page_Policy::Default);
+  bench_page_policy<float, 3>("Pages<float, 3>", SPGrid::Page_Policy::Transparent_Huge);
+  bench_page_policy<float, 3>("Pages<float, 3>", SPGrid::Page_Policy::Explicit_Huge);
+
+  bench_material<sim::mpm::FixedCorotated<float, 3>, float, 3>("FixedCorotated<float, 3>");
+  bench_material<sim::mpm::NeoHookean<float, 3>, float, 3>("NeoHookean<float, 3>");
+  bench_material<sim::mpm::Snow<float, 3>, float, 3>("Snow<float, 3>");
+  bench_material<sim::mpm::DruckerPrager<float, 3>, float, 3>("DruckerPrager<float, 3>");
+  bench_material<sim::mpm::VonMises<float, 3>, float, 3>("VonMises<float, 3>");
+
+  bench_stencil<sim::mpm::StarStencil<3>, float, 3>("Star<float, 3>");
+  bench_stencil<sim::mpm::BoxStencil<3>, float, 3>("Box<float, 3>");
+  bench_stencil<sim::mpm::StarStencil<2>, double, 2>("Star<double, 2>");
+  bench_stencil<sim::mpm::BoxStencil<2>, double, 2>("Box<double, 2>");
+
+  bench_recycling<float>("Recycling<float, 3>", 0);
+  bench_recycling<float>("Recycling<float, 3>", sim::mpm::MpmConfig<float, 3>{}.resident_grid_bytes);
+  bench_recycling<float>("Recycling<float, 3>", 0, SPGrid::Page_Policy::Transparent_Huge);
+  bench_recycling<float>("Recycling<float, 3>", 0, SPGrid::Page_Policy::Explicit_Huge);
+
+  bench_sort<float, 3>("Sort<float, 3>", 0);
+  bench_sort<float, 3>("Sort<float, 3>", 1);
+  bench_sort<float, 3>("Sort<float, 3>", sim::mpm::MpmConfig<float, 3>{}.sort_interval);
+
+  return 0;
+}
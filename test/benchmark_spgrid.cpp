@@ -0,0 +1,126 @@
+#include <SPGrid/Core/SPGrid_Geometry.h>
+#include <SPGrid/Core/SPGrid_Mask.h>
+#include <SPGrid/Core/SPGrid_Page_Map.h>
+#include <tbb/global_control.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "utils/logger.hpp"
+
+// 4096^3 domain of 4-byte cells, 2^26 blocks of 4KB
+using Mask = SPGrid::SPGrid_Mask_base<2, 3>;
+static constexpr SPGrid::ucoord_t SIZE = 4096;
+static constexpr uint64_t ACTIVATIONS = 1 << 24;
+static constexpr uint64_t BLOCKS = 1 << 23;
+
+template <class TFn> double seconds(TFn&& func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// the page map scan Generate_Block_Offsets() did before the summary bitmaps, for comparison
+class FlatScanPageMap : public SPGrid::SPGrid_Page_Map<> {
+public:
+  using SPGrid_Page_Map::SPGrid_Page_Map;
+
+  std::vector<uint64_t> Scan_Block_Offsets() const {
+    std::vector<uint64_t> result;
+    for (uint64_t entry = 0; entry < map_size; entry++)
+      for (uint64_t bits = page_map[entry]; bits; bits &= bits - 1) result.push_back(entry << (12 + 6) | uint64_t(std::countr_zero(bits)) << 12);
+    return result;
+  }
+};
+
+// offsets anywhere inside `blocks` random blocks, `activations` of them
+std::vector<uint64_t> random_offsets(SPGrid::SPGrid_Geometry<3> const& geometry, uint64_t blocks, uint64_t activations) {
+  std::mt19937_64 rng(1);
+  const uint64_t map_blocks = geometry.Padded_Volume() / geometry.Elements_Per_Block();
+  std::uniform_int_distribution<uint64_t> block(0, map_blocks - 1), byte(0, 4095);
+  std::vector<uint64_t> hot(blocks);
+  for (auto& b : hot) b = block(rng);
+  std::uniform_int_distribution<uint64_t> pick(0, blocks - 1);
+  std::vector<uint64_t> offsets(activations);
+  for (auto& offset : offsets) offset = hot[pick(rng)] << 12 | byte(rng);
+  return offsets;
+}
+
+// activations per second of serial Set_Page against Set_Page_Concurrent from 1..all cores, every
+// concurrent run must produce exactly the serial block list
+bool bench_activation(SPGrid::SPGrid_Geometry<3> const& geometry) {
+  // each block is hit twice on average
+  const auto offsets = random_offsets(geometry, BLOCKS, ACTIVATIONS);
+
+  std::vector<uint64_t> expected;
+  {
+    SPGrid::SPGrid_Page_Map<> page_map(geometry);
+    const double time = seconds([&] {
+      for (const auto offset : offsets) page_map.Set_Page(offset);
+      page_map.Update_Block_Offsets();
+    });
+    auto [ptr, count] = page_map.Get_Blocks();
+    expected.assign(ptr, ptr + count);
+    std::sort(expected.begin(), expected.end());
+    LOG_INFO("Set_Page serial: {} blocks, {:.3e} activations/s", expected.size(), ACTIVATIONS / time);
+  }
+
+  const int cores = int(std::max(4u, std::thread::hardware_concurrency()));
+  bool ok = true;
+  for (int threads = 1; threads <= cores; threads *= 2) {
+    tbb::global_control control(tbb::global_control::max_allowed_parallelism, threads);
+    tbb::task_arena arena(threads);
+    SPGrid::SPGrid_Page_Map<> page_map(geometry);
+    double activate{}, update{};
+    arena.execute([&] {
+      activate = seconds([&] {
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, offsets.size()), [&](tbb::blocked_range<size_t> const& r) {
+          for (size_t i = r.begin(); i < r.end(); ++i) page_map.Set_Page_Concurrent(offsets[i]);
+        });
+      });
+      update = seconds([&] { page_map.Update_Block_Offsets(); });
+    });
+
+    auto [ptr, count] = page_map.Get_Blocks();
+    const bool match = std::equal(ptr, ptr + count, expected.begin(), expected.end());
+    ok &= match;
+    LOG_INFO("Set_Page_Concurrent {} threads: {} blocks, {:.3e} activations/s, update {:.3f}s{}", threads, count, ACTIVATIONS / activate, update,
+             match ? "" : ", MISMATCH");
+  }
+  if (!ok) LOG_ERROR("concurrent activation differs from the serial block list");
+  return ok;
+}
+
+// Generate_Block_Offsets() against a flat scan of the page map for `blocks` active blocks, then
+// again after Clear_Active_Blocks() emptied the map
+bool bench_enumeration(SPGrid::SPGrid_Geometry<3> const& geometry, uint64_t blocks) {
+  FlatScanPageMap page_map(geometry);
+  for (const auto offset : random_offsets(geometry, blocks, blocks)) page_map.Set_Page(offset);
+  page_map.Update_Block_Offsets();
+
+  std::vector<uint64_t> flat, hierarchical;
+  const double flat_time = seconds([&] { flat = page_map.Scan_Block_Offsets(); });
+  const double hierarchical_time = seconds([&] { hierarchical = page_map.Generate_Block_Offsets(); });
+  page_map.Clear_Active_Blocks();
+  const bool ok = flat == hierarchical && page_map.Generate_Block_Offsets().empty();
+
+  LOG_INFO("Generate_Block_Offsets {} blocks: flat scan {:.2e}s, summary bitmaps {:.2e}s{}", hierarchical.size(), flat_time, hierarchical_time,
+           ok ? "" : ", MISMATCH");
+  if (!ok) LOG_ERROR("block enumeration differs from the flat scan");
+  return ok;
+}
+
+int main() {
+  LOG_INFO("Start SPGrid page map benchmark...");
+  const SPGrid::SPGrid_Geometry<3> geometry(SIZE, SIZE, SIZE, Mask::block_xbits, Mask::block_ybits, Mask::block_zbits);
+
+  bool ok = bench_activation(geometry);
+  for (uint64_t blocks : {uint64_t(1) << 10, uint64_t(1) << 16, BLOCKS}) ok &= bench_enumeration(geometry, blocks);
+  return ok ? 0 : 1;
+}
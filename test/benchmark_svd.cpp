@@ -0,0 +1,69 @@
+#include "math/svd.hpp"
+#include "utils/logger.hpp"
+#include <Eigen/SVD>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+static constexpr size_t COUNT = 1 << 16;
+static constexpr size_t REPEAT = 20;
+
+template <class TFn> double seconds(TFn&& func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// decompositions per second of Eigen::JacobiSVD against batch_svd at every supported SIMD level,
+// with the error of each level against Eigen
+template <class Real, int Dim> void bench_svd(const char* name) {
+  using TM = sim::Mat<Real, Dim, Dim>;
+  using TV = sim::Vec<Real, Dim>;
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<Real> noise(Real(-0.3), Real(0.3));
+  std::vector<TM> F(COUNT), U(COUNT), V(COUNT);
+  std::vector<TV> sigma(COUNT);
+  for (auto& f : F) f = TM::Identity() + TM::NullaryExpr([&] { return noise(rng); });
+
+  const double eigen = seconds([&] {
+    for (size_t r = 0; r < REPEAT; ++r)
+      for (size_t k = 0; k < COUNT; ++k) {
+        Eigen::JacobiSVD<TM> svd(F[k], Eigen::ComputeFullU | Eigen::ComputeFullV);
+        sigma[k] = svd.singularValues();
+      }
+  });
+  const double work = double(COUNT) * REPEAT;
+  LOG_INFO("{} Eigen::JacobiSVD: {:.3e} /s", name, work / eigen);
+
+  for (auto level : {sim::SimdLevel::scalar, sim::SimdLevel::sse, sim::SimdLevel::avx2, sim::SimdLevel::avx512}) {
+    if (level > sim::simd_supported()) continue;
+    sim::set_simd_level(level);
+    const double batch = seconds([&] {
+      for (size_t r = 0; r < REPEAT; ++r) sim::batch_svd<Real, Dim>(F, U, sigma, V);
+    });
+
+    // accuracy against Eigen: singular values and reconstruction, relative to |F|
+    double sigma_error = 0, reconstruction_error = 0;
+    for (size_t k = 0; k < COUNT; ++k) {
+      Eigen::JacobiSVD<TM> svd(F[k]);
+      sigma_error = std::max(sigma_error, double((sigma[k].cwiseAbs() - svd.singularValues()).norm() / F[k].norm()));
+      reconstruction_error = std::max(reconstruction_error, double((U[k] * sigma[k].asDiagonal() * V[k].transpose() - F[k]).norm() / F[k].norm()));
+    }
+    LOG_INFO("{} batch_svd {}: {:.3e} /s, {:.1f}x Eigen, max error sigma {:.1e} reconstruction {:.1e}", name, sim::simd_level_name(level), work / batch,
+             eigen / batch, sigma_error, reconstruction_error);
+  }
+  sim::set_simd_level(sim::simd_supported());
+}
+
+int main() {
+  LOG_INFO("Start batched SVD benchmark...");
+
+  bench_svd<float, 3>("SVD<float, 3>");
+  bench_svd<double, 3>("SVD<double, 3>");
+  bench_svd<float, 2>("SVD<float, 2>");
+  bench_svd<double, 2>("SVD<double, 2>");
+
+  return 0;
+}
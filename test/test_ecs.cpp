@@ -0,0 +1,395 @@
+#include "ecs/command_buffer.hpp"
+#include "ecs/scheduler.hpp"
+#include "math/numeric_types.hpp"
+#include "utils/logger.hpp"
+
+#include <tbb/global_control.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <span>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// checks stay on in Release builds, unlike assert()
+#define CHECK(cond)                                                 \
+  do {                                                              \
+    if (!(cond)) {                                                  \
+      LOG_ERROR("{}:{}: check failed: {}", __FILE__, __LINE__, #cond); \
+      std::abort();                                                 \
+    }                                                               \
+  } while (0)
+
+struct Position {
+  float x;
+};
+struct Velocity {
+  float x;
+};
+struct Force {
+  float x;
+};
+
+// wait until `count` reaches `target`, false after one second
+static bool wait_for(std::atomic<int> const& count, int target) {
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+  while (count.load() < target) {
+    if (std::chrono::steady_clock::now() > deadline) return false;
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+// systems without a conflicting access run at the same time, conflicting ones, exclusive ones and
+// explicit dependencies keep their registration order
+void test_scheduler() {
+  using namespace sim::ecs;
+  // enough threads for the overlap check on small machines too
+  tbb::global_control threads(tbb::global_control::max_allowed_parallelism, 4);
+
+  World world;
+  world.spawn_n<Position, Velocity, Force>(64, [](size_t) { return std::make_tuple(Position{0}, Velocity{0}, Force{1}); });
+
+  Scheduler scheduler(world);
+  std::atomic<int> stamp{0}, started{0}, running{0};
+  int order[6]{};
+  bool overlapped = false;
+  bool alone = false;
+  // marks a system body as running, for the exclusive check
+  struct Running {
+    std::atomic<int>& count;
+    explicit Running(std::atomic<int>& count) : count(count) { count.fetch_add(1); }
+    ~Running() { count.fetch_sub(1); }
+  };
+
+  // 0 and 1 write different components: each waits for the other to start
+  const auto move = scheduler.add_system<Position, const Velocity>("move", [&](auto&) {
+    Running guard(running);
+    started.fetch_add(1);
+    overlapped = wait_for(started, 2);
+    order[0] = stamp.fetch_add(1);
+  });
+  const auto force = scheduler.add_system<Force>("force", [&](auto&) {
+    Running guard(running);
+    started.fetch_add(1);
+    wait_for(started, 2);
+    order[1] = stamp.fetch_add(1);
+  });
+  // 2 reads what 0 writes
+  const auto measure = scheduler.add_system<const Position>("measure", [&](auto&) {
+    Running guard(running);
+    order[2] = stamp.fetch_add(1);
+  });
+  // 3 runs alone, after everything registered before it
+  const auto sync = scheduler.add_exclusive("sync", [&](World&) {
+    alone = running.load() == 0;
+    order[3] = stamp.fetch_add(1);
+  });
+  // 4 and 5 only read, 5 is ordered after 4 explicitly
+  const auto first = scheduler.add_system<const Velocity>("first", [&](auto&) {
+    Running guard(running);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    order[4] = stamp.fetch_add(1);
+  });
+  const auto second = scheduler.add_system<const Velocity>("second", [&](auto&) {
+    Running guard(running);
+    order[5] = stamp.fetch_add(1);
+  });
+  scheduler.add_dependency(second, first);
+
+  CHECK(scheduler.dependencies(move).empty());
+  CHECK(scheduler.dependencies(force).empty());
+  CHECK(scheduler.dependencies(measure) == std::vector<Scheduler::SystemId>{move});
+  CHECK(scheduler.dependencies(sync) == (std::vector<Scheduler::SystemId>{move, force, measure}));
+  CHECK(scheduler.dependencies(first) == std::vector<Scheduler::SystemId>{sync});
+  CHECK(scheduler.dependencies(second) == (std::vector<Scheduler::SystemId>{sync, first}));
+
+  scheduler.run();
+  CHECK(overlapped);
+  CHECK(order[0] < order[2]);
+  CHECK(order[0] < order[3] && order[1] < order[3] && order[2] < order[3]);
+  CHECK(alone);
+  CHECK(order[3] < order[4] && order[4] < order[5]);
+  LOG_INFO("test_scheduler passed");
+}
+
+// every live record points at a column holding its entity, and every column of a table at a live
+// record; `Owner` carries the id so the components can be checked to follow their entity
+struct Owner {
+  sim::ecs::EntityId eid;
+};
+
+static void check_records(sim::ecs::World& world) {
+  using namespace sim::ecs;
+  std::vector<Archetype*> tables;
+  for (uint32_t index = 0; index < world.entity_records.size(); ++index) {
+    auto const& record = world.entity_records[index];
+    if (!record.archetype) continue;
+    const auto eid = make_entity_id(index, record.generation);
+    CHECK(world.alive(eid));
+    CHECK(record.col < record.archetype->cols() && record.archetype->entities()[record.col] == eid);
+    if (record.archetype->has<Owner>()) CHECK(std::get<0>(world.get_components<Owner>(eid)).eid == eid);
+    tables.push_back(record.archetype);
+  }
+  std::sort(tables.begin(), tables.end());
+  tables.erase(std::unique(tables.begin(), tables.end()), tables.end());
+  for (auto* table : tables) {
+    for (uint32_t col = 0; col < table->cols(); ++col) {
+      auto const& record = world.entity_records[entity_index(table->entities()[col])];
+      CHECK(record.archetype == table && record.col == col);
+    }
+  }
+}
+
+// handles of destroyed entities stay invalid after their slot is reused, queries see archetypes
+// created after them, and batch moves, permutations and compaction keep the records in sync
+void test_entities() {
+  using namespace sim::ecs;
+  World world;
+  auto spawn = [&world](size_t count) {
+    auto eids = world.spawn_n<Owner, Position>(count, [](size_t) { return std::make_tuple(Owner{0}, Position{0}); });
+    std::vector<EntityId> result(eids.begin(), eids.end());
+    for (auto eid : result) std::get<0>(world.get_components<Owner>(eid)).eid = eid;
+    return result;
+  };
+
+  // destroy and respawn: the slot comes back with a new generation
+  auto first = spawn(8);
+  const auto stale = first[3];
+  CHECK(world.destroy(stale));
+  CHECK(!world.alive(stale));
+  const auto respawned = spawn(1)[0];
+  CHECK(entity_index(respawned) == entity_index(stale) && respawned != stale);
+  CHECK(world.alive(respawned) && !world.alive(stale));
+  CHECK(!world.destroy(stale));
+  CHECK(world.alive(respawned));
+  check_records(world);
+
+  // a query made before an archetype exists still matches it
+  auto query = world.query<const Position>();
+  size_t count = 0;
+  query.for_each([&](Position const&) { ++count; });
+  CHECK(count == 8);
+  auto moved = spawn(5000);
+  world.add_components_n<Velocity>(moved, Velocity{1});
+  count = 0;
+  query.for_each([&](Position const&) { ++count; });
+  CHECK(count == 5008);
+  check_records(world);
+
+  // move_n back and forth from the middle of both tables
+  std::vector<EntityId> back;
+  for (size_t i = 0; i < moved.size(); i += 3) back.push_back(moved[i]);
+  world.del_components_n<Velocity>(back);
+  check_records(world);
+
+  // permute reverses one table
+  auto& table = *world.entity_records[entity_index(moved[1])].archetype;
+  std::vector<uint32_t> order(table.cols());
+  for (uint32_t col = 0; col < order.size(); ++col) order[col] = uint32_t(order.size() - 1 - col);
+  const auto last = table.entities().back();
+  table.permute(order);
+  CHECK(table.entities().front() == last);
+  check_records(world);
+
+  std::vector<EntityId> destroyed(moved.begin(), moved.begin() + 4000);
+  world.destroy_n(destroyed);
+  world.compact();
+  check_records(world);
+  count = 0;
+  query.for_each([&](Position const&) { ++count; });
+  CHECK(count == 1008 && world.entity_count() == 1008);
+  LOG_INFO("test_entities passed");
+}
+
+// for_each_batch over several archetypes viewed through as_matrix() must match a per-element
+// for_each doing the same update
+// structural changes recorded from worker threads land once applied, and commands on the same
+// entity are applied in the order they were recorded
+void test_command_buffer() {
+  using namespace sim::ecs;
+  World world;
+  constexpr size_t count = 10000;
+  auto eids = world.spawn_n<Owner, Position>(count, [](size_t i) { return std::make_tuple(Owner{0}, Position{float(i)}); });
+  for (auto eid : eids) std::get<0>(world.get_components<Owner>(eid)).eid = eid;
+
+  ParallelCommandBuffer commands;
+  world.query<Owner, const Position>().grain(256).par_for_each_entity([&](EntityId eid, Owner&, Position const& position) {
+    auto& local = commands.local();
+    switch (size_t(position.x) % 4) {
+      case 0: local.destroy(eid); break;
+      case 1: local.add(eid, Velocity{position.x}); break;
+      case 2: local.del<Position>(eid); break;
+      case 3: local.spawn(Position{-position.x}, Force{position.x}); break;
+    }
+  });
+  // nothing moves before apply()
+  CHECK(world.entity_count() == count);
+  commands.apply(world);
+  check_records(world);
+
+  size_t moved = 0, spawned = 0, stripped = 0;
+  world.query<const Position, const Velocity>().for_each([&](Position const& position, Velocity const& velocity) {
+    CHECK(size_t(position.x) % 4 == 1 && velocity.x == position.x);
+    ++moved;
+  });
+  world.query<const Position, const Force>().for_each([&](Position const& position, Force const& force) {
+    CHECK(size_t(force.x) % 4 == 3 && position.x == -force.x);
+    ++spawned;
+  });
+  world.query<const Owner>().for_each([&](Owner const&) { ++stripped; });
+  world.query<const Owner, const Position>().for_each([&](Owner const&, Position const&) { --stripped; });
+  CHECK(moved == count / 4 && spawned == count / 4 && stripped == count / 4);
+  CHECK(world.entity_count() == count);
+
+  // commands on one entity go to successive waves and keep their recorded order, other entities
+  // share the waves
+  auto targets = world.spawn_n<Position>(4, [](size_t i) { return std::make_tuple(Position{float(i)}); });
+  std::vector<EntityId> ids(targets.begin(), targets.end());
+  CommandBuffer buffer;
+  buffer.destroy(ids[0]);
+  buffer.add(ids[0], Velocity{1});
+  buffer.add(ids[1], Velocity{1});
+  buffer.destroy(ids[1]);
+  buffer.add(ids[2], Velocity{1});
+  buffer.del<Velocity>(ids[2]);
+  buffer.add(ids[2], Velocity{2});
+  buffer.add(ids[3], Velocity{3});
+  buffer.apply(world);
+  CHECK(!world.alive(ids[0]) && !world.alive(ids[1]));
+  CHECK(std::get<0>(world.get_components<Velocity>(ids[2])).x == 2);
+  CHECK(std::get<0>(world.get_components<Velocity>(ids[3])).x == 3);
+  CHECK(world.entity_count() == count + 2);
+  check_records(world);
+  LOG_INFO("test_command_buffer passed");
+}
+
+// changed_since only visits the chunks written after the given tick, whatever wrote them
+void test_changes() {
+  using namespace sim::ecs;
+  constexpr size_t chunk = sim::data::Column::chunk_size;
+  constexpr size_t count = 3 * chunk + 100;
+  World world;
+  auto spawned = world.spawn_n<Position, Velocity>(count, [](size_t i) { return std::make_tuple(Position{float(i)}, Velocity{0}); });
+  std::vector<EntityId> eids(spawned.begin(), spawned.end());
+  auto query = world.query<const Position, const Velocity>();
+  auto visit = [&query](uint64_t tick) {
+    size_t visited = 0;
+    query.changed_since(tick).for_each([&](Position const&, Velocity const&) { ++visited; });
+    return visited;
+  };
+
+  auto tick = world.change_tick();
+  CHECK(visit(tick) == 0);
+
+  // set: only the second chunk is written
+  world.set_components(eids[chunk + 5], Position{-1});
+  size_t visited = 0;
+  query.changed_since(tick).for_each([&](Position const& position, Velocity const&) {
+    CHECK(position.x == -1 || (position.x >= float(chunk) && position.x < float(2 * chunk)));
+    ++visited;
+  });
+  CHECK(visited == chunk);
+  // reading through const components stamps nothing
+  CHECK(visit(tick) == chunk);
+  CHECK(visit(world.change_tick()) == 0);
+
+  // a pass with a mutable component stamps every chunk it visits
+  tick = world.change_tick();
+  world.query<Velocity>().for_each([](Velocity& velocity) { velocity.x += 1; });
+  CHECK(visit(tick) == count);
+
+  // move_n out of the first chunk: the hole is filled from the back, only its chunk changes
+  tick = world.change_tick();
+  const EntityId moved[] = {eids[10]};
+  world.del_components_n<Velocity>(moved);
+  CHECK(visit(tick) == chunk);
+
+  // permute rewrites every chunk
+  tick = world.change_tick();
+  auto& table = *world.entity_records[entity_index(eids[0])].archetype;
+  std::vector<uint32_t> order(table.cols());
+  for (uint32_t col = 0; col < order.size(); ++col) order[col] = uint32_t(order.size() - 1 - col);
+  table.permute(order);
+  CHECK(visit(tick) == count - 1);
+  LOG_INFO("test_changes passed");
+}
+
+// stats() reports live and allocated column bytes, compact() gives the slack back
+void test_stats() {
+  using namespace sim::ecs;
+  constexpr size_t chunk = sim::data::Column::chunk_size;
+  constexpr size_t count = 5 * chunk + 10;
+  constexpr size_t row_bytes = sizeof(Position) + sizeof(Velocity);
+  World world;
+  auto spawned = world.spawn_n<Position, Velocity>(count, [](size_t i) { return std::make_tuple(Position{float(i)}, Velocity{0}); });
+  std::vector<EntityId> eids(spawned.begin(), spawned.end());
+  auto table_stats = [](WorldStats const& stats) {
+    auto iter = std::find_if(stats.archetypes.begin(), stats.archetypes.end(), [](auto const& table) { return table.columns.size() == 2; });
+    CHECK(iter != stats.archetypes.end());
+    return *iter;
+  };
+
+  const auto before = world.stats();
+  const auto table_before = table_stats(before);
+  CHECK(before.entities == count && table_before.entities == count);
+  CHECK(table_before.used_bytes == count * row_bytes);
+  // six chunks per column
+  CHECK(table_before.reserved_bytes >= 6 * chunk * row_bytes);
+  CHECK(before.column_used_bytes == table_before.used_bytes && before.column_reserved_bytes >= table_before.reserved_bytes);
+
+  constexpr size_t kept = 100;
+  world.destroy_n(std::span<const EntityId>(eids).first(count - kept));
+  world.compact();
+  const auto after = world.stats();
+  const auto table_after = table_stats(after);
+  CHECK(after.entities == kept && after.free_slots == count - kept);
+  CHECK(table_after.used_bytes == kept * row_bytes);
+  CHECK(table_after.reserved_bytes >= chunk * row_bytes && table_after.reserved_bytes < 2 * chunk * row_bytes);
+  CHECK(after.column_used_bytes < before.column_used_bytes && after.column_reserved_bytes < before.column_reserved_bytes);
+  CHECK(after.total_bytes() < before.total_bytes());
+  LOG_INFO("test_stats passed, {} -> {} bytes", before.total_bytes(), after.total_bytes());
+}
+
+void test_batch() {
+  using namespace sim;
+  using Vec3 = Vec<float, 3>;
+  using Vec2 = Vec<float, 2>;
+  ecs::World world;
+  world.spawn_n<Vec3, Vec2>(10000, [](size_t i) { return std::make_tuple(Vec3(float(i), 0, 0), Vec2(0, float(i % 7))); });
+  // a second archetype holding the queried components, both span several column chunks
+  world.spawn_n<Vec3, Vec2, Force>(10000, [](size_t i) { return std::make_tuple(Vec3(0, float(i), 0), Vec2::Ones(), Force{float(i)}); });
+
+  auto query = world.query<Vec3, const Vec2>();
+  std::vector<Vec3> expected;
+  query.for_each([&](Vec3& x, Vec2 const& v) { expected.push_back(x * 2 + Vec3(v[0], v[1], 1)); });
+
+  size_t batches = 0;
+  query.for_each_batch([&](std::span<Vec3> xs, std::span<const Vec2> vs) {
+    auto X = as_matrix(xs);
+    const auto V = as_matrix(vs);
+    X *= 2;
+    X.topRows<2>() += V;
+    X.row(2).array() += 1;
+    ++batches;
+  });
+  CHECK(batches >= 2);
+
+  size_t i = 0;
+  query.for_each([&](Vec3& x, Vec2 const&) { CHECK(x == expected[i++]); });
+  CHECK(i == expected.size());
+  LOG_INFO("test_batch passed, {} batches", batches);
+}
+
+int main() {
+  test_entities();
+  test_command_buffer();
+  test_changes();
+  test_stats();
+  test_scheduler();
+  test_batch();
+  return 0;
+}